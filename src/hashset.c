@@ -16,41 +16,141 @@
  limitations under the License.
 */
 
+#include <stdint.h>
+
 #include "include/hashset.h"
-#include "include/hstr_utils.h"
 
-unsigned int hashmap_hash(const char *str)
+#define HASHMAP_MULTIPLIER 0x9E3779B97F4A7C15ull
+#define HASHMAP_FINALIZER  0xBF58476D1CE4E5B9ull
+
+HASHMAP_DEFINE(HashSet, hashset_map)
+
+#define HASHMAP_ONES  0x0101010101010101ull
+#define HASHMAP_HIGHS 0x8080808080808080ull
+// the smallest page size i.e. words which don't cross it are in mapped memory
+#define HASHMAP_PAGE_SIZE 4096
+
+// word read past NUL of key (but within its page) is not an overflow
+#if defined(__GNUC__)
+#define HASHMAP_NO_SANITIZE __attribute__((no_sanitize_address))
+#else
+#define HASHMAP_NO_SANITIZE
+#endif
+
+/*
+ * Key is hashed a word (8 bytes) at a time: each word is mixed in with one multiplication
+ * and tail bytes are mixed in as one zero padded word. Length is mixed in last so that
+ * NUL terminated key can be hashed while its length is found. Words are read in native
+ * byte order i.e. hashes are not portable between architectures.
+ */
+
+static inline unsigned hashmap_finalize(uint64_t result, unsigned length)
 {
-    int i;
-    unsigned int result=5381;
+    result=(result^length)*HASHMAP_MULTIPLIER;
+    // low bits index tables > high bits are mixed in
+    result^=result>>29;
+    result*=HASHMAP_FINALIZER;
+    result^=result>>32;
+    return (unsigned)result;
+}
 
-    for(i=0; str[i]!='\0'; i++) {
-        result=result*33+str[i];
+unsigned hashmap_hash(const char *key, unsigned length)
+{
+    uint64_t result=HASHMAP_MULTIPLIER, word;
+    const char *end=key+(length&~7u);
+    for(; key<end; key+=8) {
+        memcpy(&word, key, 8);
+        result=(result^word)*HASHMAP_MULTIPLIER;
+        result^=result>>32;
+    }
+    if(length&7) {
+        word=0;
+        memcpy(&word, key, length&7);
+        result=(result^word)*HASHMAP_MULTIPLIER;
     }
-    result = result^(result>>16);
+    return hashmap_finalize(result, length);
+}
 
-    return result%HASH_MAP_SIZE;
+/*
+ * NUL terminated key is hashed as hashmap_hash() hashes it and its length is found in
+ * the same pass - words are tested for NUL as they are mixed in. Word which would cross
+ * a page is read only if the key doesn't end in the current page.
+ */
+HASHMAP_NO_SANITIZE unsigned hashmap_hash_string(const char *key, unsigned *length)
+{
+    uint64_t result=HASHMAP_MULTIPLIER, word, zeros;
+    const char *p=key;
+    unsigned tail;
+    while(true) {
+        if(((uintptr_t)p&(HASHMAP_PAGE_SIZE-1))>HASHMAP_PAGE_SIZE-8
+                && memchr(p, 0, HASHMAP_PAGE_SIZE-((uintptr_t)p&(HASHMAP_PAGE_SIZE-1)))) {
+            tail=strlen(p);
+            word=0;
+            memcpy(&word, p, tail);
+            break;
+        }
+        memcpy(&word, p, 8);
+        if((zeros=(word-HASHMAP_ONES)&~word&HASHMAP_HIGHS)) {
+#if defined(__GNUC__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+            // the lowest flagged byte is the first NUL - bytes after it are masked out
+            tail=__builtin_ctzll(zeros)/8;
+            word&=((uint64_t)1<<tail*8)-1;
+#else
+            tail=strlen(p);
+            word=0;
+            memcpy(&word, p, tail);
+#endif
+            break;
+        }
+        result=(result^word)*HASHMAP_MULTIPLIER;
+        result^=result>>32;
+        p+=8;
+    }
+    if(tail) {
+        result=(result^word)*HASHMAP_MULTIPLIER;
+    }
+    *length=p-key+tail;
+    return hashmap_finalize(result, *length);
 }
 
 void hashset_init(HashSet * hs)
 {
-    int i;
-    hs->currentSize = 0;
-    for(i = 0; i<HASH_MAP_SIZE; i++) {
-        hs->lists[i] = NULL;
-    }
+    hashset_init_arena(hs, ARENA_HASHSET);
 }
 
-void *hashset_get(const HashSet * hs, const char *key)
+// memory of hashset is accounted to the subsystem
+void hashset_init_arena(HashSet *hs, int subsystem)
 {
-    int listNum = hashmap_hash( key );
-    struct HashSetNode *ptr = hs->lists[ listNum ];
+    hashset_map_init(hs, subsystem, false);
+}
 
-    while(ptr != NULL && strcmp(ptr->key, key)!= 0) {
-        ptr = ptr->next;
-    }
+// keys are not copied - they must outlive the set
+void hashset_init_borrowed(HashSet *hs, int subsystem)
+{
+    hashset_map_init(hs, subsystem, true);
+}
 
-    return (ptr!=NULL?ptr->value:NULL);
+void hashset_reserve(HashSet *hs, unsigned count)
+{
+    hashset_map_reserve(hs, count);
+}
+
+// hash of the key is passed by callers which cache it (see hashmap_hash())
+void *hashset_get_hashed(const HashSet *hs, const char *key, unsigned length, unsigned hash)
+{
+    HashSetSlot *slot=hashset_map_find(hs, key, length, hash);
+    return (slot!=NULL?slot->value:NULL);
+}
+
+void *hashset_get_view(const HashSet *hs, const char *key, unsigned length)
+{
+    return hashset_get_hashed(hs, key, length, hashmap_hash(key, length));
+}
+
+void *hashset_get(const HashSet * hs, const char *key)
+{
+    unsigned length, hash=hashmap_hash_string(key, &length);
+    return hashset_get_hashed(hs, key, length, hash);
 }
 
 int hashset_contains(const HashSet * hs, const char *key)
@@ -58,27 +158,35 @@ int hashset_contains(const HashSet * hs, const char *key)
     return (hashset_get(hs, key) != NULL);
 }
 
-int hashset_put(HashSet *hs, const char *key, void *value)
+int hashset_contains_hashed(const HashSet *hs, const char *key, unsigned length, unsigned hash)
 {
-    if(hashset_get(hs, key)) {
-        return 0;
-    } else {
-        int listNum = hashmap_hash( key );
-        struct HashSetNode *newNode=(struct HashSetNode *)malloc(sizeof(struct HashSetNode));
-        if(newNode == NULL) {
-            fprintf(stderr,"Unable to allocate hashset entry!");
-            return 0;
-        }
-
-        newNode->key=malloc(strlen(key)+1);
-        strcpy(newNode->key, key);
-        newNode->value=value;
-        newNode->next=hs->lists[listNum];
-        hs->lists[listNum]=newNode;
-        hs->currentSize++;
+    return (hashset_get_hashed(hs, key, length, hash) != NULL);
+}
 
-        return 1;
+int hashset_put_hashed(HashSet *hs, const char *key, unsigned length, unsigned hash, void *value)
+{
+    bool added;
+    HashSetSlot *slot=hashset_map_put_hashed(hs, key, length, hash, &added);
+    if(added) {
+        slot->value=value;
     }
+    return added;
+}
+
+int hashset_put_view(HashSet *hs, const char *key, unsigned length, void *value)
+{
+    return hashset_put_hashed(hs, key, length, hashmap_hash(key, length), value);
+}
+
+int hashset_put(HashSet *hs, const char *key, void *value)
+{
+    unsigned length, hash=hashmap_hash_string(key, &length);
+    return hashset_put_hashed(hs, key, length, hash, value);
+}
+
+int hashset_remove(HashSet *hs, const char *key)
+{
+    return hashset_map_remove(hs, key, strlen(key));
 }
 
 int hashset_add(HashSet * hs, const char *key)
@@ -93,59 +201,43 @@ int hashset_size(const HashSet *hs)
 
 void hashset_stat(const HashSet *hs)
 {
-    int i;
-    struct HashSetNode *ptr;
-    for(i=0; i<HASH_MAP_SIZE; i++) {
-        for(ptr=hs->lists[i]; ptr!=NULL; ptr=ptr->next) {
-            printf("%s\n",ptr->key);
-        }
+    unsigned position=0;
+    HashSetSlot *slot;
+    while((slot=hashset_map_next(hs, &position))!=NULL) {
+        printf("%.*s\n",(int)slot->length,slot->key);
     }
 }
 
-char** hashset_keys(const HashSet *hs)
+void hashset_iterator_init(HashSetIterator *it, const HashSet *hs)
 {
-    if(hs->currentSize) {
-        char **result=malloc(sizeof(char*) * hs->currentSize);
-        int i=0, j=0;
-        struct HashSetNode *p;
-        for(i=0; i<HASH_MAP_SIZE; i++) {
-            p=hs->lists[i];
-            while(p && p->next) {
-                result[j++]=hstr_strdup(p->key);
-                p=p->next;
-            }
-            if(p) {
-                result[j++]=hstr_strdup(p->key);
-            }
-        }
-        return result;
-    } else {
-        return NULL;
+    it->hs=hs;
+    it->slot=0;
+}
+
+// next key (NULL when iterated) - its length and value are returned unless NULL is passed
+const char *hashset_iterator_next(HashSetIterator *it, unsigned *length, void **value)
+{
+    HashSetSlot *slot=hashset_map_next(it->hs, &it->slot);
+    if(slot) {
+        if(length) *length=slot->length;
+        if(value) *value=slot->value;
+        return slot->key;
     }
+    return NULL;
 }
 
 void hashset_destroy(HashSet *hs, const bool freeValues)
 {
-    // only hashset keys (and possibly values) are freed - caller must free hashset itself
-    if(hs && hs->currentSize) {
-        int i=0;
-        struct HashSetNode *p, *pp;
-        for(i=0; i<HASH_MAP_SIZE; i++) {
-            p=hs->lists[i];
-            while(p && p->next) {
-                if(p->key) {
-                    free(p->key);
-                    if(freeValues && p->value) free(p->value);
-                }
-                pp=p;
-                p=p->next;
-                free(pp);
-            }
-            if(p && p->key) {
-                free(p->key);
-                if(freeValues && p->value) free(p->value);
-                free(p);
+    // only hashset slots (and possibly values) are freed - caller must free hashset itself
+    if(hs) {
+        if(freeValues && hs->currentSize) {
+            unsigned position=0;
+            HashSetSlot *slot;
+            while((slot=hashset_map_next(hs, &position))!=NULL) {
+                if(slot->value) free(slot->value);
             }
         }
+        // keys are released at once
+        hashset_map_destroy(hs);
     }
 }
@@ -40,8 +40,12 @@
 #include "include/hashset.h"
 #include "include/hstr_curses.h"
 #include "include/hstr_blacklist.h"
+#include "include/hstr_candidates.h"
+#include "include/hstr_casefold.h"
+#include "include/hstr_dedup.h"
 #include "include/hstr_favorites.h"
 #include "include/hstr_history.h"
+#include "include/hstr_matcher.h"
 #include "include/hstr_regexp.h"
 #include "include/hstr_utils.h"
 
@@ -51,6 +55,8 @@
 #define HOSTNAME_BUFFER 128
 
 #define PG_JUMP_SIZE 10
+// keyboard polling period while history is loaded in background
+#define HH_LOADING_POLL_MS 100
 
 #define K_CTRL_A 1
 #define K_CTRL_E 5
@@ -107,10 +113,11 @@
 #define HH_CONFIG_KEEP_PAGE  "keep-page"
 #define HH_CONFIG_DEBUG      "debug"
 #define HH_CONFIG_WARN       "warning"
-#define HH_CONFIG_BIG_KEYS_SKIP  "big-keys-skip"
-#define HH_CONFIG_BIG_KEYS_FLOOR "big-keys-floor"
-#define HH_CONFIG_BIG_KEYS_EXIT  "big-keys-exit"
 #define HH_CONFIG_DUPLICATES "duplicates"
+#define HH_CONFIG_TIME_DECAY "time-decay"
+#define HH_CONFIG_ADDITIVE   "additive"
+#define HH_CONFIG_FREQUENCY  "frequency"
+#define HH_CONFIG_MEMORY_BUDGET "memory-budget"
 
 #define HH_DEBUG_LEVEL_NONE  0
 #define HH_DEBUG_LEVEL_WARN  1
@@ -155,6 +162,12 @@
 #define LOGSELECTION(Y,SCREEN,MODEL)
 #endif
 
+#ifdef DEBUG_ARENA
+#define LOGARENA() arena_stat()
+#else
+#define LOGARENA()
+#endif
+
 static const char *HH_VIEW_LABELS[]={
         "ranking",
         "history",
@@ -262,7 +275,8 @@ typedef struct {
 
     char **selection;
     unsigned selectionSize;
-    regmatch_t *selectionRegexpMatch;
+    // matched spans of selected items
+    regmatch_t *selectionMatch;
 
     int historyMatch; // TODO patternMatching: exact, regexp
     int historyView; // TODO view: favorites, ...
@@ -273,10 +287,15 @@ typedef struct {
 
     unsigned char theme;
     bool keepPage; // do NOT clear page w/ selection on HH exit
-    int bigKeys;
+    int ranking;
+    bool memoryBudget;
     int debugLevel;
 
     HstrRegexp regexp;
+    // candidates of patterns typed so far
+    CandidateStack candidates;
+    // commands selected by the current selection (if unique)
+    SelectionDedup dedup;
 
     Blacklist blacklist;
 
@@ -296,7 +315,7 @@ static Hstr *hstr;
 void hstr_init()
 {
     hstr->selection=NULL;
-    hstr->selectionRegexpMatch=NULL;
+    hstr->selectionMatch=NULL;
     hstr->selectionSize=0;
 
     hstr->historyMatch=HH_MATCH_SUBSTRING;
@@ -307,13 +326,16 @@ void hstr_init()
     hstr->unique=true;
 
     hstr->theme=HH_THEME_MONO;
-    hstr->bigKeys=RADIX_BIG_KEYS_SKIP;
+    hstr->ranking=HISTORY_RANKING_ORDER;
+    hstr->memoryBudget=false;
     hstr->debugLevel=HH_DEBUG_LEVEL_NONE;
 
     blacklist_init(&hstr->blacklist);
 
     hstr->cmdline[0]=0;
     hstr_regexp_init(&hstr->regexp);
+    candidates_init(&hstr->candidates);
+    dedup_init(&hstr->dedup);
 }
 
 unsigned recalculate_max_history_items()
@@ -348,6 +370,7 @@ void hstr_get_env_configuration(Hstr *hstr)
         }
         if(strstr(hstr_config,HH_CONFIG_CASE)) {
             hstr->caseSensitive=HH_CASE_SENSITIVE;
+            hstr->regexp.caseSensitive=true;
         }
         if(strstr(hstr_config,HH_CONFIG_REGEXP)) {
             hstr->historyMatch=HH_MATCH_REGEXP;
@@ -367,15 +390,20 @@ void hstr_get_env_configuration(Hstr *hstr)
                 hstr->historyView=HH_VIEW_FAVORITES;
             }
         }
-        if(strstr(hstr_config,HH_CONFIG_BIG_KEYS_EXIT)) {
-            hstr->bigKeys=RADIX_BIG_KEYS_EXIT;
+        if(strstr(hstr_config,HH_CONFIG_TIME_DECAY)) {
+            hstr->ranking=HISTORY_RANKING_TIME_DECAY;
         } else {
-            if(strstr(hstr_config,HH_CONFIG_BIG_KEYS_FLOOR)) {
-                hstr->bigKeys=RADIX_BIG_KEYS_FLOOR;
+            if(strstr(hstr_config,HH_CONFIG_ADDITIVE)) {
+                hstr->ranking=HISTORY_RANKING_ADDITIVE;
             } else {
-                hstr->bigKeys=RADIX_BIG_KEYS_SKIP;
+                if(strstr(hstr_config,HH_CONFIG_FREQUENCY)) {
+                    hstr->ranking=HISTORY_RANKING_FREQUENCY;
+                }
             }
         }
+        if(strstr(hstr_config,HH_CONFIG_MEMORY_BUDGET)) {
+            hstr->memoryBudget=true;
+        }
         if(strstr(hstr_config,HH_CONFIG_BLACKLIST)) {
             hstr->blacklist.useFile=true;
         }
@@ -436,18 +464,26 @@ int print_prompt()
     return promptLength;
 }
 
-void add_to_selection(Hstr *hstr, char *line, unsigned int *index)
+// id of i-th item of source which is the same for equal commands (see SelectionDedup)
+static unsigned hstr_item_id(Hstr *hstr, HistoryItems *history, char **source, unsigned i, char *item, unsigned length)
 {
-    if (hstr->unique) {
-        int i;
-        for(i = 0; i < *index; i++) {
-            if (strcmp(hstr->selection[i], line) == 0) {
-                return;
-            }
-        }
+    if(!hstr->unique || source==history->items) {
+        return i;
+    }
+    if(source && source==history->rawItems) {
+        return history->rawIds[i];
+    }
+    return dedup_intern(&hstr->dedup, item, length);
+}
+
+bool add_to_selection(Hstr *hstr, char *line, unsigned id, unsigned int *index)
+{
+    if (hstr->unique && !dedup_add(&hstr->dedup, id)) {
+        return false;
     }
     hstr->selection[*index]=line;
     *index = *index + 1;
+    return true;
 }
 
 void print_help_label()
@@ -533,13 +569,14 @@ void print_history_label()
     int width=getmaxx(stdscr);
 
     char screenLine[CMDLINE_LNG];
-    snprintf(screenLine, width, "- HISTORY - view:%s (C-7) - match:%s (C-e) - case:%s (C-t) - %d/%d/%d ",
+    snprintf(screenLine, width, "- HISTORY - view:%s (C-7) - match:%s (C-e) - case:%s (C-t) - %d/%d/%d %s",
             HH_VIEW_LABELS[hstr->historyView],
             HH_MATCH_LABELS[hstr->historyMatch],
             HH_CASE_LABELS[hstr->caseSensitive],
             hstr->history->count,
             hstr->history->rawCount,
-            hstr->favorites->count);
+            hstr->favorites->count,
+            history_is_loading()?"(loading) ":"");
     width -= strlen(screenLine);
     unsigned i;
     for (i=0; i < width; i++) {
@@ -574,20 +611,207 @@ void hstr_realloc_selection(unsigned size, Hstr *hstr)
         if(size) {
             hstr->selection
                 =realloc(hstr->selection, sizeof(char*) * size);
-            hstr->selectionRegexpMatch
-                =realloc(hstr->selectionRegexpMatch, sizeof(regmatch_t) * size);
+            hstr->selectionMatch
+                =realloc(hstr->selectionMatch, sizeof(regmatch_t) * size);
         } else {
             free(hstr->selection);
-            free(hstr->selectionRegexpMatch);
+            free(hstr->selectionMatch);
             hstr->selection=NULL;
-            hstr->selectionRegexpMatch=NULL;
+            hstr->selectionMatch=NULL;
         }
     } else {
         if(size) {
             hstr->selection = malloc(sizeof(char*) * size);
-            hstr->selectionRegexpMatch = malloc(sizeof(regmatch_t) * size);
+            hstr->selectionMatch = malloc(sizeof(regmatch_t) * size);
+        }
+    }
+}
+
+#define CANDIDATE_NONE   0
+#define CANDIDATE_PREFIX 1
+#define CANDIDATE_INFIX  2
+
+// substring pattern or its keywords compiled once per selection
+typedef struct {
+    Matcher substring;
+    Matcher *keywords;
+    unsigned keywordsCount;
+    // case insensitive query is folded and matched against folded items
+    bool folded;
+    HistoryItems *history;
+    char *foldBuffer;
+    unsigned foldBufferSize;
+} HstrQuery;
+
+static void hstr_query_init(HstrQuery *query, char *pattern, unsigned patternLength, Hstr *hstr)
+{
+    query->folded=hstr->caseSensitive==HH_CASE_INSENSITIVE;
+    query->history=hstr->history;
+    query->foldBuffer=NULL;
+    query->foldBufferSize=0;
+    char *needle=malloc(patternLength+1);
+    if(query->folded) {
+        casefold(needle, pattern, patternLength+1);
+    } else {
+        memcpy(needle, pattern, patternLength+1);
+    }
+    matcher_init(&query->substring, needle, patternLength);
+    query->keywords=NULL;
+    query->keywordsCount=0;
+    if(hstr->historyMatch==HH_MATCH_KEYWORDS) {
+        char *keywordsSavePtr=NULL, *keywordsToken;
+        query->keywords=malloc(sizeof(Matcher) * (patternLength/2+1));
+        for(keywordsToken=strtok_r(needle, " ", &keywordsSavePtr);
+                keywordsToken;
+                keywordsToken=strtok_r(NULL, " ", &keywordsSavePtr)) {
+            matcher_init(&query->keywords[query->keywordsCount++], keywordsToken, strlen(keywordsToken));
+        }
+    }
+    free(needle);
+}
+
+static void hstr_query_destroy(HstrQuery *query)
+{
+    unsigned k;
+    for(k=0; k<query->keywordsCount; k++) {
+        matcher_destroy(&query->keywords[k]);
+    }
+    free(query->keywords);
+    matcher_destroy(&query->substring);
+    free(query->foldBuffer);
+}
+
+// text searched for query - folded copy of item from folded corpus or folded on the fly
+static char *hstr_query_haystack(HstrQuery *query, char *item, unsigned length)
+{
+    if(!query->folded) {
+        return item;
+    }
+    char *folded=history_folded_item(query->history, item);
+    if(folded) {
+        return folded;
+    }
+    if(length+1>query->foldBufferSize) {
+        query->foldBufferSize=2*(length+1);
+        query->foldBuffer=realloc(query->foldBuffer, query->foldBufferSize);
+    }
+    casefold(query->foldBuffer, item, length+1);
+    return query->foldBuffer;
+}
+
+/*
+ * How item matches substring pattern or keywords - all keyword matches are prefix ones.
+ * Offset of substring match is returned so that it's not searched again when printed.
+ */
+static int hstr_match_candidate(Hstr *hstr, HstrQuery *query, char *item, unsigned length, int *offset)
+{
+    char *haystack=hstr_query_haystack(query, item, length);
+    if(hstr->historyMatch==HH_MATCH_KEYWORDS) {
+        unsigned k;
+        for(k=0; k<query->keywordsCount; k++) {
+            if(matcher_find(&query->keywords[k], haystack, length)==MATCHER_NONE) {
+                return CANDIDATE_NONE;
+            }
+        }
+        *offset=0;
+        return CANDIDATE_PREFIX;
+    }
+    *offset=matcher_find(&query->substring, haystack, length);
+    if(*offset==MATCHER_NONE) {
+        return CANDIDATE_NONE;
+    }
+    return *offset?CANDIDATE_INFIX:CANDIDATE_PREFIX;
+}
+
+static void hstr_set_selection_match(Hstr *hstr, unsigned index, int offset, unsigned length)
+{
+    hstr->selectionMatch[index].rm_so=offset;
+    hstr->selectionMatch[index].rm_eo=offset+length;
+}
+
+/*
+ * Item which contains the pattern (or its keywords) contains every prefix of the pattern
+ * too. Therefore when the typed pattern extends the previous one, only candidates of
+ * the previous pattern are matched and backspace pops back to the candidates of the
+ * shorter pattern w/o matching at all.
+ */
+static unsigned hstr_make_narrowed_selection(char *prefix, unsigned prefixLength, HistoryItems *history,
+        char **source, unsigned *lengths, unsigned count, int maxSelectionCount, Hstr *hstr)
+{
+    candidates_validate(&hstr->candidates, source, count, hstr->historyView, hstr->historyMatch, hstr->caseSensitive);
+    CandidateLevel *level=candidates_narrowest(&hstr->candidates, prefix, prefixLength);
+    if(!level || level->patternLength<prefixLength) {
+        // parent level is moved by push > its candidates are remembered
+        unsigned *parentIds=level?level->ids:NULL;
+        unsigned parentCount=level?level->count:count;
+        unsigned parentPrefixCount=level?level->prefixCount:0;
+
+        HstrQuery query;
+        hstr_query_init(&query, prefix, prefixLength, hstr);
+        level=candidates_push(&hstr->candidates, prefix, prefixLength, parentCount);
+        unsigned *infixIds=malloc(sizeof(unsigned) * (parentCount?parentCount:1));
+        unsigned *infixOffsets=malloc(sizeof(unsigned) * (parentCount?parentCount:1));
+        unsigned n, id, length, infixCount=0, p=0, q=parentPrefixCount;
+        int offset;
+        for(n=0; n<parentCount; n++) {
+            if(parentIds) {
+                // prefix and infix runs of the parent are merged back to source order
+                if(q==parentCount || (p<parentPrefixCount && parentIds[p]<parentIds[q])) {
+                    id=parentIds[p++];
+                } else {
+                    id=parentIds[q++];
+                }
+            } else {
+                id=n;
+                if(source==history->items && id==history->rankedCount) {
+                    // items beyond the top ranked ones are ordered only when they're scanned
+                    history_rank_items(history, id+1);
+                }
+            }
+            length=lengths?lengths[id]:strlen(source[id]);
+            // items shorter than pattern cannot match
+            if(hstr->historyMatch==HH_MATCH_SUBSTRING && length<prefixLength) {
+                continue;
+            }
+            switch(hstr_match_candidate(hstr, &query, source[id], length, &offset)) {
+            case CANDIDATE_PREFIX:
+                level->offsets[level->prefixCount]=offset;
+                level->ids[level->prefixCount++]=id;
+                break;
+            case CANDIDATE_INFIX:
+                infixOffsets[infixCount]=offset;
+                infixIds[infixCount++]=id;
+                break;
+            }
+        }
+        memcpy(level->ids+level->prefixCount, infixIds, sizeof(unsigned) * infixCount);
+        memcpy(level->offsets+level->prefixCount, infixOffsets, sizeof(unsigned) * infixCount);
+        level->count=level->prefixCount+infixCount;
+        free(infixIds);
+        free(infixOffsets);
+        hstr_query_destroy(&query);
+    }
+
+    unsigned i, id, length, selectionCount=0;
+    for(i=0; i<level->count && selectionCount<maxSelectionCount; i++) {
+        id=level->ids[i];
+        length=lengths?lengths[id]:strlen(source[id]);
+        if(add_to_selection(hstr, source[id], hstr_item_id(hstr, history, source, id, source[id], length), &selectionCount)) {
+            hstr_set_selection_match(hstr, selectionCount-1, level->offsets[i], prefixLength);
         }
     }
+    hstr->selectionSize=selectionCount;
+    return selectionCount;
+}
+
+// infix matches are appended to prefix matches (w/o being counted in selection)
+static void hstr_append_infix(Hstr *hstr, unsigned selectionCount, char **infix, regmatch_t *infixMatch, unsigned infixCount)
+{
+    if(!infixCount) {
+        return;
+    }
+    memcpy(hstr->selection+selectionCount, infix, sizeof(char*) * infixCount);
+    memcpy(hstr->selectionMatch+selectionCount, infixMatch, sizeof(regmatch_t) * infixCount);
 }
 
 unsigned hstr_make_selection(char *prefix, HistoryItems *history, int maxSelectionCount, Hstr *hstr)
@@ -596,57 +820,110 @@ unsigned hstr_make_selection(char *prefix, HistoryItems *history, int maxSelecti
 
     unsigned i, selectionCount=0;
     char **source;
+    // byte lengths of source items (unknown for favorites)
+    unsigned *lengths;
     unsigned count;
 
     switch(hstr->historyView) {
     case HH_VIEW_HISTORY:
-        source=history->rawItems;
+        // paged raw history items are lexed on demand
+        source=history->rawPages?NULL:history->rawItems;
+        lengths=history->rawPages?NULL:history->rawLengths;
         count=history->rawCount;
         break;
     case HH_VIEW_FAVORITES:
         source=hstr->favorites->items;
+        lengths=NULL;
         count=hstr->favorites->count;
         break;
     case HH_VIEW_RANKING:
     default:
         source=history->items;
+        lengths=history->lengths;
         count=history->count;
         break;
     }
+    size_t prefixLength=prefix?strlen(prefix):0;
+    if(hstr->unique) {
+        dedup_begin(&hstr->dedup);
+    }
+
+    // regexp is not narrowed by extension and favorites are reordered when chosen
+    if(prefixLength && source && hstr->historyView!=HH_VIEW_FAVORITES && hstr->historyMatch!=HH_MATCH_REGEXP) {
+        return hstr_make_narrowed_selection(prefix, prefixLength, history, source, lengths, count, maxSelectionCount, hstr);
+    }
 
     regmatch_t regexpMatch;
     char regexpErrorMessage[CMDLINE_LNG];
     bool regexpCompilationError=false;
-    bool keywordsAllMatch;
-    char *keywordsSavePtr=NULL;
-    char *keywordsToken;
-    char *keywordsParsedLine;
-    char *keywordsPointerToDelete;
+    HstrQuery query;
+    if(prefixLength) {
+        hstr_query_init(&query, prefix, prefixLength, hstr);
+    }
+    // substring matches are classified in one pass: prefix matches are added to selection
+    // and the first infix matches which may still fit are kept to be appended to them
+    char **infix=NULL;
+    regmatch_t *infixMatch=NULL;
+    unsigned infixCount=0;
+    if(prefixLength && hstr->historyMatch==HH_MATCH_SUBSTRING) {
+        infix=malloc(sizeof(char*) * (maxSelectionCount?maxSelectionCount:1));
+        infixMatch=malloc(sizeof(regmatch_t) * (maxSelectionCount?maxSelectionCount:1));
+    }
+    int offset;
+    unsigned length, nextRetain=HISTORY_RAW_RETAIN_PERIOD;
+    char *item;
     for(i=0; i<count && selectionCount<maxSelectionCount; i++) {
-        if(source[i]) {
-            if(!prefix || !strlen(prefix)) {
-                add_to_selection(hstr, source[i], &selectionCount);
+        if(!source && i==nextRetain) {
+            // scanned pages w/o selected items are released - retaining is as far apart
+            // as selection is big so that it takes linear time in total
+            hstr_append_infix(hstr, selectionCount, infix, infixMatch, infixCount);
+            history_raw_retain(history, hstr->selection, selectionCount+infixCount);
+            nextRetain=i+HISTORY_RAW_RETAIN_PERIOD+selectionCount+infixCount;
+        }
+        if(source==history->items && i==history->rankedCount) {
+            // items beyond the top ranked ones are ordered only when they're scanned
+            history_rank_items(history, i+1);
+        }
+        item=source?source[i]:history_raw_item(history, i);
+        if(item) {
+            if(!prefixLength) {
+                length=lengths?lengths[i]:strlen(item);
+                add_to_selection(hstr, item, hstr_item_id(hstr, history, source, i, item, length), &selectionCount);
             } else {
                 switch(hstr->historyMatch) {
                 case HH_MATCH_SUBSTRING:
-                    switch(hstr->caseSensitive) {
-                    case HH_CASE_SENSITIVE:
-                        if(source[i]==strstr(source[i], prefix)) {
-                            add_to_selection(hstr, source[i], &selectionCount);
+                case HH_MATCH_KEYWORDS:
+                    length=lengths?lengths[i]:strlen(item);
+                    // items shorter than prefix cannot match
+                    if(hstr->historyMatch==HH_MATCH_SUBSTRING && length<prefixLength) {
+                        break;
+                    }
+                    switch(hstr_match_candidate(hstr, &query, item, length, &offset)) {
+                    case CANDIDATE_PREFIX:
+                        if(add_to_selection(hstr, item, hstr_item_id(hstr, history, source, i, item, length), &selectionCount)) {
+                            hstr_set_selection_match(hstr, selectionCount-1, offset, prefixLength);
+                            if(selectionCount+infixCount>maxSelectionCount) {
+                                // the last kept infix match no longer fits
+                                infixCount--;
+                            }
                         }
                         break;
-                    case HH_CASE_INSENSITIVE:
-                        if(source[i]==strcasestr(source[i], prefix)) {
-                            add_to_selection(hstr, source[i], &selectionCount);
+                    case CANDIDATE_INFIX:
+                        // evicted infix match stays marked as no infix match fits since then
+                        if(selectionCount+infixCount<maxSelectionCount
+                                && (!hstr->unique || dedup_add(&hstr->dedup, hstr_item_id(hstr, history, source, i, item, length)))) {
+                            infixMatch[infixCount].rm_so=offset;
+                            infixMatch[infixCount].rm_eo=offset+prefixLength;
+                            infix[infixCount++]=item;
                         }
                         break;
                     }
                     break;
                 case HH_MATCH_REGEXP:
-                    if(hstr_regexp_match(&(hstr->regexp), prefix, source[i], &regexpMatch, regexpErrorMessage, CMDLINE_LNG)) {
-                        hstr->selection[selectionCount]=source[i];
-                        hstr->selectionRegexpMatch[selectionCount].rm_so=regexpMatch.rm_so;
-                        hstr->selectionRegexpMatch[selectionCount].rm_eo=regexpMatch.rm_eo;
+                    if(hstr_regexp_match(&(hstr->regexp), prefix, item, &regexpMatch, regexpErrorMessage, CMDLINE_LNG)) {
+                        hstr->selection[selectionCount]=item;
+                        hstr->selectionMatch[selectionCount].rm_so=regexpMatch.rm_so;
+                        hstr->selectionMatch[selectionCount].rm_eo=regexpMatch.rm_eo;
                         selectionCount++;
                     } else {
                         if(!regexpCompilationError) {
@@ -656,75 +933,26 @@ unsigned hstr_make_selection(char *prefix, HistoryItems *history, int maxSelecti
                         }
                     }
                     break;
-                case HH_MATCH_KEYWORDS:
-                    keywordsParsedLine = strdup(prefix);
-                    keywordsAllMatch = true;
-                    keywordsPointerToDelete = keywordsParsedLine;
-                    while(true) {
-                        keywordsToken = strtok_r(keywordsParsedLine, " ", &keywordsSavePtr);
-                        if (keywordsToken == NULL) {
-                            break;
-                        }
-                        keywordsParsedLine = NULL;
-                        switch(hstr->caseSensitive) {
-                        case HH_CASE_SENSITIVE:
-                            if(strstr(source[i], keywordsToken) == NULL) {
-                                keywordsAllMatch = false;
-                            }
-                            break;
-                        case HH_CASE_INSENSITIVE:
-                            if(strcasestr(source[i], keywordsToken) == NULL) {
-                                keywordsAllMatch = false;
-                            }
-                            break;
-                        }
-                    }
-                    if(keywordsAllMatch) {
-                        add_to_selection(hstr, source[i], &selectionCount);
-                    }
-                    free(keywordsPointerToDelete);
-                    break;
                 }
             }
         }
     }
+    hstr_append_infix(hstr, selectionCount, infix, infixMatch, infixCount);
+    selectionCount+=infixCount;
+    free(infix);
+    free(infixMatch);
 
-    if(prefix && selectionCount<maxSelectionCount) {
-        char *substring;
-        for(i=0; i<count && selectionCount<maxSelectionCount; i++) {
-            switch(hstr->historyMatch) {
-            case HH_MATCH_SUBSTRING:
-                switch(hstr->caseSensitive) {
-                case HH_CASE_SENSITIVE:
-                    substring = strstr(source[i], prefix);
-                    if (substring != NULL && substring!=source[i]) {
-                        add_to_selection(hstr, source[i], &selectionCount);
-                    }
-                    break;
-                case HH_CASE_INSENSITIVE:
-                    substring = strcasestr(source[i], prefix);
-                    if (substring != NULL && substring!=source[i]) {
-                        add_to_selection(hstr, source[i], &selectionCount);
-                    }
-                    break;
-                }
-                break;
-            case HH_MATCH_REGEXP:
-                // all regexps matched previously - user decides whether match ^ or infix
-            break;
-            case HH_MATCH_KEYWORDS:
-                // TODO MD consider adding lines that didn't matched all keywords, but some of them
-                //         (ordered by number of matched keywords)
-            break;
-            }
-        }
+    if(prefixLength) {
+        hstr_query_destroy(&query);
+    }
+    if(!source) {
+        history_raw_retain(history, hstr->selection, selectionCount);
     }
-
     hstr->selectionSize=selectionCount;
     return selectionCount;
 }
 
-void print_selection_row(char *text, int y, int width, char *pattern)
+void print_selection_row(char *text, int y, int width, char *pattern, regmatch_t *match)
 {
     char screenLine[CMDLINE_LNG];
     snprintf(screenLine, width, " %s", text);
@@ -735,56 +963,30 @@ void print_selection_row(char *text, int y, int width, char *pattern)
         if(hstr->theme & HH_THEME_COLOR) {
             color_attr_on(COLOR_PAIR(HH_COLOR_MATCH));
         }
-        char* p;
-        char* pp;
-        char* keywordsSavePtr;
-        char* keywordsToken;
-        char* keywordsParsedLine;
-        char* keywordsPointerToDelete;
+        HstrQuery query;
+        char *haystack;
+        unsigned k, length;
+        int offset;
 
         switch(hstr->historyMatch) {
         case HH_MATCH_SUBSTRING:
-            switch(hstr->caseSensitive) {
-            case HH_CASE_INSENSITIVE:
-                p=strcasestr(text, pattern);
-                snprintf(screenLine, strlen(pattern)+1, "%s", p);
-                mvprintw(y, 1+(p-text), "%s", screenLine);
-                break;
-            case HH_CASE_SENSITIVE:
-                p=strstr(text, pattern);
-                mvprintw(y, 1+(p-text), "%s", pattern);
-                break;
-            }
-            break;
         case HH_MATCH_REGEXP:
-            p=strstr(text, pattern);
-            mvprintw(y, 1+(p-text), "%s", pattern);
+            // span matched when selection was made
+            snprintf(screenLine, MIN(match->rm_eo-match->rm_so+1, CMDLINE_LNG), "%s", text+match->rm_so);
+            mvprintw(y, 1+match->rm_so, "%s", screenLine);
             break;
         case HH_MATCH_KEYWORDS:
-            keywordsParsedLine = strdup(pattern);
-            keywordsPointerToDelete = keywordsParsedLine;
-            while (true) {
-                keywordsToken = strtok_r(keywordsParsedLine, " ", &keywordsSavePtr);
-                keywordsParsedLine = NULL;
-                if (keywordsToken == NULL) {
-                    break;
-                }
-                switch(hstr->caseSensitive) {
-                case HH_CASE_SENSITIVE:
-                    p=strstr(text, keywordsToken);
-                    mvprintw(y, 1+(p-text), "%s", keywordsToken);
-                    break;
-                case HH_CASE_INSENSITIVE:
-                    p=strcasestr(text, keywordsToken);
-                    pp=strdup(p);
-                    pp[strlen(keywordsToken)]=0;
-                    mvprintw(y, 1+(p-text), "%s", pp);
-                    free(pp);
-                    break;
+            hstr_query_init(&query, pattern, strlen(pattern), hstr);
+            length=strlen(text);
+            haystack=hstr_query_haystack(&query, text, length);
+            for(k=0; k<query.keywordsCount; k++) {
+                offset=matcher_find(&query.keywords[k], haystack, length);
+                if(offset!=MATCHER_NONE) {
+                    snprintf(screenLine, query.keywords[k].length+1, "%s", text+offset);
+                    mvprintw(y, 1+offset, "%s", screenLine);
                 }
             }
-            free(keywordsPointerToDelete);
-
+            hstr_query_destroy(&query);
             break;
         }
         if(hstr->theme & HH_THEME_COLOR) {
@@ -839,29 +1041,9 @@ char *hstr_print_selection(unsigned maxHistoryItems, char *pattern, Hstr *hstr)
         y=hstr->promptYItemsStart;
     }
 
-    int start, count;
-    char screenLine[CMDLINE_LNG];
     for (i = 0; i<height; ++i) {
         if(i<hstr->selectionSize) {
-            // TODO make this function
-            if(pattern && strlen(pattern)) {
-                if(hstr->historyMatch==HH_MATCH_REGEXP) {
-                    start=hstr->selectionRegexpMatch[i].rm_so;
-                    count=hstr->selectionRegexpMatch[i].rm_eo-start;
-                    if(count>CMDLINE_LNG) {
-                        count=CMDLINE_LNG-1;
-                    }
-                    strncpy(screenLine,
-                            hstr->selection[i]+start,
-                            count);
-                    screenLine[count]=0;
-                } else {
-                    strcpy(screenLine, pattern);
-                }
-                print_selection_row(hstr->selection[i], y, width, screenLine);
-            } else {
-                print_selection_row(hstr->selection[i], y, width, pattern);
-            }
+            print_selection_row(hstr->selection[i], y, width, pattern, &hstr->selectionMatch[i]);
         } else {
             mvprintw(y, 0, " ");
         }
@@ -880,19 +1062,6 @@ char *hstr_print_selection(unsigned maxHistoryItems, char *pattern, Hstr *hstr)
 void highlight_selection(int selectionCursorPosition, int previousSelectionCursorPosition, char *pattern, Hstr *hstr)
 {
     if(previousSelectionCursorPosition!=SELECTION_CURSOR_IN_PROMPT) {
-        // TODO make this function
-        char buffer[CMDLINE_LNG];
-        if(pattern && strlen(pattern) && hstr->historyMatch==HH_MATCH_REGEXP) {
-            int start=hstr->selectionRegexpMatch[previousSelectionCursorPosition].rm_so;
-            int end=hstr->selectionRegexpMatch[previousSelectionCursorPosition].rm_eo-start;
-            strncpy(buffer,
-                    hstr->selection[previousSelectionCursorPosition]+start,
-                    end);
-            buffer[end]=0;
-        } else {
-            strcpy(buffer, pattern);
-        }
-
         int text, y;
         if(hstr->promptBottom) {
             text=hstr->promptItems-previousSelectionCursorPosition-1;
@@ -905,7 +1074,8 @@ void highlight_selection(int selectionCursorPosition, int previousSelectionCurso
                 hstr->selection[text],
                 y,
                 getmaxx(stdscr),
-                buffer);
+                pattern,
+                &hstr->selectionMatch[text]);
     }
     if(selectionCursorPosition!=SELECTION_CURSOR_IN_PROMPT) {
         int text, y;
@@ -939,6 +1109,26 @@ void signal_callback_handler_ctrl_c(int signum)
     }
 }
 
+// keyboard is polled while history is loaded or its index waits for idle time to be saved
+static void hstr_poll_keyboard()
+{
+    timeout(history_is_loading() || history_index_pending() ? HH_LOADING_POLL_MS : -1);
+}
+
+// history loaded in background replaces provisional history - true if it was swapped
+bool hstr_swap_history(Hstr *hstr, bool wait)
+{
+    HistoryItems *history=history_finish_loading(wait);
+    if(history) {
+        hstr->history=history;
+        candidates_clear(&hstr->candidates);
+        // no more history to wait for > block on keyboard again (once index is saved)
+        hstr_poll_keyboard();
+        return true;
+    }
+    return false;
+}
+
 int remove_from_history_model(char *delete, Hstr *hstr)
 {
     if(hstr->historyView==HH_VIEW_FAVORITES) {
@@ -947,6 +1137,7 @@ int remove_from_history_model(char *delete, Hstr *hstr)
         // raw & ranked history is pruned first as its items point to system history lines
         int systemOccurences=0, rawOccurences=history_mgmt_remove_from_raw(delete, hstr->history);
         history_mgmt_remove_from_ranked(delete, hstr->history);
+        candidates_clear(&hstr->candidates);
         if(rawOccurences) {
             systemOccurences=history_mgmt_remove_from_system_history(delete);
         }
@@ -963,7 +1154,69 @@ void hstr_next_view(Hstr *hstr)
     hstr->historyView=hstr->historyView%3;
 }
 
+/*
+ * Paged raw history is printed while it's scanned so that its pages are released right
+ * away - selection of whole history would keep all its pages lexed. Prefix matches are
+ * printed by the first scan and infix matches by the second one (as they're selected).
+ */
+static void hstr_print_paged_history(char *prefix, HistoryItems *history, Hstr *hstr)
+{
+    size_t prefixLength=prefix?strlen(prefix):0;
+    bool regexp=prefixLength && hstr->historyMatch==HH_MATCH_REGEXP;
+    regmatch_t regexpMatch;
+    char regexpErrorMessage[CMDLINE_LNG];
+    HstrQuery query;
+    if(prefixLength) {
+        hstr_query_init(&query, prefix, prefixLength, hstr);
+    }
+    if(hstr->unique) {
+        dedup_begin(&hstr->dedup);
+    }
+    int scan, lastScan=prefixLength && hstr->historyMatch==HH_MATCH_SUBSTRING?CANDIDATE_INFIX:CANDIDATE_PREFIX;
+    int match, offset;
+    unsigned i, length;
+    char *item;
+    for(scan=CANDIDATE_PREFIX; scan<=lastScan; scan++) {
+        for(i=0; i<history->rawCount; i++) {
+            item=history_raw_item(history, i);
+            if(i && !(i%HISTORY_RAW_RETAIN_PERIOD)) {
+                // printed items are not needed anymore - only the page being scanned is kept
+                history_raw_retain(history, &item, 1);
+            }
+            if(!item) {
+                continue;
+            }
+            length=strlen(item);
+            match=CANDIDATE_PREFIX;
+            if(regexp) {
+                if(!hstr_regexp_match(&(hstr->regexp), prefix, item, &regexpMatch, regexpErrorMessage, CMDLINE_LNG)) {
+                    match=CANDIDATE_NONE;
+                }
+            } else if(prefixLength) {
+                // items shorter than prefix cannot match
+                if(hstr->historyMatch==HH_MATCH_SUBSTRING && length<prefixLength) {
+                    match=CANDIDATE_NONE;
+                } else {
+                    match=hstr_match_candidate(hstr, &query, item, length, &offset);
+                }
+            }
+            // regexp matches are not deduplicated in selection either
+            if(match==scan && (!hstr->unique || regexp || dedup_add(&hstr->dedup, dedup_intern(&hstr->dedup, item, length)))) {
+                printf("%s\n", item);
+            }
+        }
+    }
+    history_raw_retain(history, NULL, 0);
+    if(prefixLength) {
+        hstr_query_destroy(&query);
+    }
+}
+
 void stdout_history_and_return(Hstr *hstr) {
+    if(hstr->historyView==HH_VIEW_HISTORY && hstr->history->rawPages) {
+        hstr_print_paged_history(hstr->cmdline, hstr->history, hstr);
+        return;
+    }
     unsigned selectionCount=hstr_make_selection(hstr->cmdline, hstr->history, hstr->history->rawCount, hstr);
     if (selectionCount > 0) {
         int i;
@@ -996,6 +1249,9 @@ void loop_to_select(Hstr *hstr)
         color_init_pair(HH_COLOR_MATCH, COLOR_RED, -1);
     }
 
+    // keyboard is polled so that loaded history can be shown
+    hstr_poll_keyboard();
+
     color_attr_on(COLOR_PAIR(HH_COLOR_NORMAL));
     // TODO why do I print non-filtered selection when on command line there is a pattern?
     hstr_print_selection(recalculate_max_history_items(), NULL, hstr);
@@ -1023,7 +1279,22 @@ void loop_to_select(Hstr *hstr)
         maxHistoryItems=recalculate_max_history_items();
 
         if(!skip) {
+            // loaded history is swapped in between keystrokes (not only when user is idle) - items
+            // are not reordered under selection cursor > swap only when it's in prompt
+            if(selectionCursorPosition==SELECTION_CURSOR_IN_PROMPT && hstr_swap_history(hstr, false)) {
+                result=hstr_print_selection(maxHistoryItems, pattern, hstr);
+                print_history_label();
+                move(hstr->promptY, basex+hstr_strlen(pattern));
+            }
             c = wgetch(stdscr);
+            if(c==ERR) {
+                if(history_index_pending()) {
+                    // history is shown and user is idle
+                    history_save_index();
+                    hstr_poll_keyboard();
+                }
+                continue;
+            }
         } else {
             if(strlen(pattern)) {
                 color_attr_on(A_BOLD);
@@ -1057,14 +1328,18 @@ void loop_to_select(Hstr *hstr)
                 strcpy(msg,delete);
 
                 print_confirm_delete(msg, hstr);
+                timeout(-1);
                 cc = wgetch(stdscr);
                 if(cc == 'y') {
+                    // command is deleted from complete history
+                    hstr_swap_history(hstr, true);
                     deletedOccurences=remove_from_history_model(msg, hstr);
                     result=hstr_print_selection(maxHistoryItems, pattern, hstr);
                     print_cmd_deleted_label(msg, deletedOccurences, hstr);
                 } else {
                     print_help_label();
                 }
+                hstr_poll_keyboard();
                 free(msg);
                 move(hstr->promptY, basex+strlen(pattern));
                 printDefaultLabel=TRUE;
@@ -1382,13 +1657,19 @@ void hstr_init_favorites(Hstr *hstr)
 
 void hstr_main(Hstr *hstr)
 {
-    hstr->history=get_prioritized_history(hstr->bigKeys, hstr->blacklist.set);
+    if(hstr->interactive) {
+        // first page is shown before big history is loaded
+        hstr->history=get_prioritized_history_progressively(hstr->ranking, hstr->blacklist.set, hstr->memoryBudget);
+    } else {
+        hstr->history=get_prioritized_history(hstr->ranking, hstr->blacklist.set, hstr->memoryBudget);
+    }
     if(hstr->history) {
         history_mgmt_open();
         if(hstr->interactive) {
             loop_to_select(hstr);
         } else {
             stdout_history_and_return(hstr);
+            LOGARENA();
         }
         hstr_on_exit(hstr);
     } else {
@@ -1456,6 +1737,8 @@ int main(int argc, char *argv[])
     hstr_main(hstr);
 
     favorites_destroy(hstr->favorites);
+    candidates_destroy(&hstr->candidates);
+    dedup_destroy(&hstr->dedup);
     free(hstr);
 
     return EXIT_SUCCESS;
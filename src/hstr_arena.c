@@ -0,0 +1,168 @@
+/*
+ hstr_arena.c       region allocator with per subsystem accounting
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hstr_arena.h"
+
+static const char *subsystemNames[ARENA_SUBSYSTEMS]={
+    "history", "ranking", "hashset", "favorites", "blacklist", "selection"
+};
+
+// bytes of blocks held by subsystems (arenas are used by ranking threads too)
+static size_t subsystemSizes[ARENA_SUBSYSTEMS];
+static size_t subsystemPeaks[ARENA_SUBSYSTEMS];
+static pthread_mutex_t subsystemMutex=PTHREAD_MUTEX_INITIALIZER;
+
+// memory allocated outside of arenas can be accounted to subsystems too
+void arena_account(int subsystem, size_t size, bool held)
+{
+    pthread_mutex_lock(&subsystemMutex);
+    if(held) {
+        subsystemSizes[subsystem]+=size;
+        if(subsystemSizes[subsystem]>subsystemPeaks[subsystem]) {
+            subsystemPeaks[subsystem]=subsystemSizes[subsystem];
+        }
+    } else {
+        subsystemSizes[subsystem]-=size;
+    }
+    pthread_mutex_unlock(&subsystemMutex);
+}
+
+void arena_init(Arena *arena, int subsystem)
+{
+    memset(arena, 0, sizeof(Arena));
+    arena->blockSize=ARENA_MIN_BLOCK_SIZE;
+    arena->subsystem=subsystem;
+}
+
+static size_t arena_align(size_t size)
+{
+    return size<ARENA_ALIGNMENT?ARENA_ALIGNMENT:(size+ARENA_ALIGNMENT-1)&~(size_t)(ARENA_ALIGNMENT-1);
+}
+
+// the least class whose allocations are at least size big
+static unsigned arena_class(size_t size)
+{
+    unsigned sizeClass=0;
+    while(((size_t)1<<sizeClass)<size) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size=arena_align(size);
+    unsigned sizeClass=arena_class(size);
+    void **reused=arena->freeLists[sizeClass];
+    if(reused) {
+        arena->freeLists[sizeClass]=*reused;
+        return reused;
+    }
+    if((size_t)(arena->end-arena->next)<size) {
+        // big allocations get a block of their own
+        size_t blockSize=size;
+        if(size<=ARENA_BLOCK_SIZE/4) {
+            while(arena->blockSize<size) {
+                arena->blockSize*=2;
+            }
+            blockSize=arena->blockSize;
+            if(arena->blockSize<ARENA_BLOCK_SIZE) {
+                arena->blockSize*=2;
+            }
+        }
+        blockSize+=sizeof(ArenaBlock);
+        ArenaBlock *block=malloc(blockSize);
+        if(!block) {
+            fprintf(stderr, "Unable to allocate arena block!");
+            exit(EXIT_FAILURE);
+        }
+        block->size=blockSize;
+        arena_account(arena->subsystem, blockSize, true);
+        char *data=(char*)block+arena_align(sizeof(ArenaBlock));
+        if(size>ARENA_BLOCK_SIZE/4 && arena->blocks) {
+            // current block stays the bump allocation block
+            block->next=arena->blocks->next;
+            arena->blocks->next=block;
+            return data;
+        }
+        block->next=arena->blocks;
+        arena->blocks=block;
+        arena->next=data;
+        arena->end=(char*)block+blockSize;
+    }
+    void *result=arena->next;
+    arena->next+=size;
+    return result;
+}
+
+char *arena_strdup(Arena *arena, const char *s)
+{
+    size_t size=strlen(s)+1;
+    return memcpy(arena_alloc(arena, size), s, size);
+}
+
+// allocation can be reused by allocations of the class it fits
+void arena_free(Arena *arena, void *p, size_t size)
+{
+    size=arena_align(size);
+    unsigned sizeClass=arena_class(size);
+    if(((size_t)1<<sizeClass)>size) {
+        sizeClass--;
+    }
+    *(void**)p=arena->freeLists[sizeClass];
+    arena->freeLists[sizeClass]=p;
+}
+
+void arena_release(Arena *arena)
+{
+    ArenaBlock *block=arena->blocks, *next;
+    while(block) {
+        next=block->next;
+        arena_account(arena->subsystem, block->size, false);
+        free(block);
+        block=next;
+    }
+    arena_init(arena, arena->subsystem);
+}
+
+size_t arena_size(int subsystem)
+{
+    pthread_mutex_lock(&subsystemMutex);
+    size_t result=subsystemSizes[subsystem];
+    pthread_mutex_unlock(&subsystemMutex);
+    return result;
+}
+
+void arena_stat()
+{
+    int i;
+    printf("\nArenas (held/peak bytes):");
+    pthread_mutex_lock(&subsystemMutex);
+    for(i=0; i<ARENA_SUBSYSTEMS; i++) {
+        printf("\n  %-10s %zu %zu", subsystemNames[i], subsystemSizes[i], subsystemPeaks[i]);
+    }
+    pthread_mutex_unlock(&subsystemMutex);
+    printf("\n");
+    fflush(stdout);
+}
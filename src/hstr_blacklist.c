@@ -34,7 +34,7 @@ void blacklist_init(Blacklist *blacklist)
     blacklist->isLoaded=false;
     blacklist->isDefault=false;
     blacklist->set=malloc(sizeof(HashSet));
-    hashset_init(blacklist->set);
+    hashset_init_arena(blacklist->set, ARENA_BLACKLIST);
 }
 
 char* blacklist_get_filename()
@@ -81,14 +81,12 @@ void blacklist_load(Blacklist *blacklist)
                     while (p!=NULL) {
                         p=strchr(p+1,'\n');
                     }
-                    char *pb=fileContent, *pe, *s;
+                    char *pb=fileContent, *pe;
                     pe=strchr(fileContent, '\n');
                     while(pe!=NULL) {
                         *pe=0;
-                        if(!hashset_contains(blacklist->set,pb)) {
-                            s=hstr_strdup(pb);
-                            hashset_add(blacklist->set,s);
-                        }
+                        // command is copied by the set (unless it's there already)
+                        hashset_add(blacklist->set,pb);
                         pb=pe+1;
                         pe=strchr(pb, '\n');
                     }
@@ -117,10 +115,11 @@ void blacklist_dump(Blacklist *blacklist)
         int size=hashset_size(blacklist->set);
         if(size) {
             printf("Command blacklist (%d):\n",size);
-            int i;
-            char **keys=hashset_keys(blacklist->set);
-            for(i=0; i<size; i++) {
-                printf("  '%s'\n",keys[i]);
+            HashSetIterator it;
+            const char *key;
+            hashset_iterator_init(&it, blacklist->set);
+            while((key=hashset_iterator_next(&it, NULL, NULL))!=NULL) {
+                printf("  '%s'\n",key);
             }
             return;
         }
@@ -137,10 +136,12 @@ void blacklist_destroy(Blacklist *blacklist)
             if(size) {
                 FILE *output_file = fopen(fileName, "wb");
                 rewind(output_file);
-                int i;
-                char **keys=hashset_keys(blacklist->set);
-                for(i=0; i<size; i++) {
-                    if(fwrite(keys[i], sizeof(char), strlen(keys[i]), output_file)==-1) {
+                HashSetIterator it;
+                const char *key;
+                unsigned length;
+                hashset_iterator_init(&it, blacklist->set);
+                while((key=hashset_iterator_next(&it, &length, NULL))!=NULL) {
+                    if(fwrite(key, sizeof(char), length, output_file)==-1) {
                         exit(EXIT_FAILURE);
                     }
                     if(fwrite("\n", sizeof(char), strlen("\n"), output_file)==-1) {
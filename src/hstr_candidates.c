@@ -0,0 +1,129 @@
+/*
+ hstr_candidates.c  stack of candidates of incrementally typed pattern
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hstr_candidates.h"
+#include "include/hstr_casefold.h"
+
+#define CANDIDATES_INITIAL_CAPACITY 16
+
+void candidates_init(CandidateStack *stack)
+{
+    stack->levels=NULL;
+    stack->depth=0;
+    stack->capacity=0;
+    stack->source=NULL;
+    stack->sourceCount=0;
+    stack->view=-1;
+    stack->match=-1;
+    stack->caseSensitive=-1;
+}
+
+static void candidates_pop(CandidateStack *stack)
+{
+    CandidateLevel *level=&stack->levels[--stack->depth];
+    free(level->pattern);
+    free(level->ids);
+    free(level->offsets);
+}
+
+void candidates_clear(CandidateStack *stack)
+{
+    while(stack->depth) {
+        candidates_pop(stack);
+    }
+}
+
+// levels are dropped if they were computed for different source or matching - true if kept
+bool candidates_validate(CandidateStack *stack, char **source, unsigned sourceCount, int view, int match, int caseSensitive)
+{
+    if(stack->source==source && stack->sourceCount==sourceCount
+            && stack->view==view && stack->match==match && stack->caseSensitive==caseSensitive) {
+        return true;
+    }
+    candidates_clear(stack);
+    stack->source=source;
+    stack->sourceCount=sourceCount;
+    stack->view=view;
+    stack->match=match;
+    stack->caseSensitive=caseSensitive;
+    return false;
+}
+
+/*
+ * Levels are keyed on folded patterns: pattern typed byte by byte may end w/ incomplete
+ * UTF-8 character which folds to other bytes than the complete one (e.g. lead byte of
+ * Cyrillic capital letter ER), so its level doesn't narrow the completed pattern.
+ */
+static char *candidates_key(const CandidateStack *stack, const char *pattern, unsigned patternLength)
+{
+    char *key=malloc(patternLength+1);
+    if(stack->caseSensitive) {
+        memcpy(key, pattern, patternLength+1);
+    } else {
+        casefold(key, pattern, patternLength+1);
+    }
+    return key;
+}
+
+/*
+ * Levels of patterns which are not prefixes of the pattern (e.g. after backspace) are
+ * popped. The top level is returned - its candidates are superset of the pattern's ones.
+ */
+CandidateLevel *candidates_narrowest(CandidateStack *stack, const char *pattern, unsigned patternLength)
+{
+    char *key=candidates_key(stack, pattern, patternLength);
+    CandidateLevel *level=NULL;
+    while(stack->depth) {
+        level=&stack->levels[stack->depth-1];
+        if(level->patternLength<=patternLength && !memcmp(level->pattern, key, level->patternLength)) {
+            break;
+        }
+        candidates_pop(stack);
+        level=NULL;
+    }
+    free(key);
+    return level;
+}
+
+// level w/ room for maxCount candidates - pointer is valid until the next push
+CandidateLevel *candidates_push(CandidateStack *stack, const char *pattern, unsigned patternLength, unsigned maxCount)
+{
+    if(stack->depth==stack->capacity) {
+        stack->capacity=stack->capacity?2*stack->capacity:CANDIDATES_INITIAL_CAPACITY;
+        stack->levels=realloc(stack->levels, sizeof(CandidateLevel) * stack->capacity);
+    }
+    CandidateLevel *level=&stack->levels[stack->depth++];
+    level->pattern=candidates_key(stack, pattern, patternLength);
+    level->patternLength=patternLength;
+    level->ids=malloc(sizeof(unsigned) * (maxCount?maxCount:1));
+    level->offsets=malloc(sizeof(unsigned) * (maxCount?maxCount:1));
+    level->prefixCount=0;
+    level->count=0;
+    return level;
+}
+
+void candidates_destroy(CandidateStack *stack)
+{
+    candidates_clear(stack);
+    free(stack->levels);
+    stack->levels=NULL;
+    stack->capacity=0;
+}
@@ -0,0 +1,131 @@
+/*
+ hstr_casefold.c    case folding of history items
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "include/hstr_casefold.h"
+
+/*
+ * Lowercase of code point if its UTF-8 encoding has the same length as the one of
+ * the code point (code point itself otherwise). Cased letters of Latin, Greek, Cyrillic
+ * and Armenian scripts are folded - except few whose lowercase has different length
+ * e.g. dotted capital I or capital sharp s.
+ */
+static unsigned casefold_codepoint(unsigned c)
+{
+    if(c<0x80) {
+        return (c>='A' && c<='Z')?c+0x20:c;
+    }
+    // Latin-1 Supplement, Latin Extended-A and -B
+    if(c>=0xC0 && c<=0xDE && c!=0xD7) {
+        return c+0x20;
+    }
+    if((c>=0x100 && c<=0x12F) || (c>=0x132 && c<=0x137) || (c>=0x14A && c<=0x177)
+            || (c>=0x1DE && c<=0x1EF) || (c>=0x1F8 && c<=0x21F) || (c>=0x222 && c<=0x233)) {
+        return c|1;
+    }
+    if((c>=0x139 && c<=0x148) || (c>=0x179 && c<=0x17E) || (c>=0x1CD && c<=0x1DC)) {
+        return (c&1)?c+1:c;
+    }
+    if(c==0x178) {
+        return 0xFF;
+    }
+    // digraphs: uppercase, titlecase and lowercase
+    if(c>=0x1C4 && c<=0x1CB) {
+        return c-(c-0x1C4)%3+2;
+    }
+    // Greek
+    if(c==0x386) {
+        return 0x3AC;
+    }
+    if(c>=0x388 && c<=0x38A) {
+        return c+0x25;
+    }
+    if(c==0x38C) {
+        return 0x3CC;
+    }
+    if(c==0x38E || c==0x38F) {
+        return c+0x3F;
+    }
+    if((c>=0x391 && c<=0x3A1) || (c>=0x3A3 && c<=0x3AB)) {
+        return c+0x20;
+    }
+    if(c==0x3C2) {
+        return 0x3C3;
+    }
+    // Cyrillic
+    if(c>=0x400 && c<=0x40F) {
+        return c+0x50;
+    }
+    if(c>=0x410 && c<=0x42F) {
+        return c+0x20;
+    }
+    if((c>=0x460 && c<=0x481) || (c>=0x48A && c<=0x4BF) || (c>=0x4D0 && c<=0x52F)) {
+        return c|1;
+    }
+    if(c==0x4C0) {
+        return 0x4CF;
+    }
+    if(c>=0x4C1 && c<=0x4CE) {
+        return (c&1)?c+1:c;
+    }
+    // Armenian
+    if(c>=0x531 && c<=0x556) {
+        return c+0x30;
+    }
+    // Latin Extended Additional and fullwidth Latin
+    if((c>=0x1E00 && c<=0x1E95) || (c>=0x1EA0 && c<=0x1EFF)) {
+        return c|1;
+    }
+    if(c>=0xFF21 && c<=0xFF3A) {
+        return c+0x20;
+    }
+    return c;
+}
+
+/*
+ * Folded copy of UTF-8 text is written to the buffer of the same size. Folding preserves
+ * length of every character i.e. offsets in folded text are offsets in the text. Bytes
+ * which are not part of well-formed 1-3 byte sequences are copied as they are.
+ */
+void casefold(char *folded, const char *text, size_t size)
+{
+    const unsigned char *s=(const unsigned char*)text;
+    unsigned char *f=(unsigned char*)folded;
+    size_t i=0;
+    unsigned c;
+    while(i<size) {
+        if(s[i]<0x80) {
+            f[i]=(s[i]>='A' && s[i]<='Z')?s[i]+0x20:s[i];
+            i++;
+        } else if(s[i]>=0xC2 && s[i]<=0xDF && i+1<size && (s[i+1]&0xC0)==0x80) {
+            c=casefold_codepoint(((s[i]&0x1F)<<6) | (s[i+1]&0x3F));
+            f[i]=0xC0 | (c>>6);
+            f[i+1]=0x80 | (c&0x3F);
+            i+=2;
+        } else if((s[i]&0xF0)==0xE0 && i+2<size && (s[i+1]&0xC0)==0x80 && (s[i+2]&0xC0)==0x80
+                && (s[i]!=0xE0 || s[i+1]>=0xA0)) {
+            c=casefold_codepoint(((s[i]&0x0F)<<12) | ((s[i+1]&0x3F)<<6) | (s[i+2]&0x3F));
+            f[i]=0xE0 | (c>>12);
+            f[i+1]=0x80 | ((c>>6)&0x3F);
+            f[i+2]=0x80 | (c&0x3F);
+            i+=3;
+        } else {
+            f[i]=s[i];
+            i++;
+        }
+    }
+}
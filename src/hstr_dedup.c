@@ -0,0 +1,105 @@
+/*
+ hstr_dedup.c       deduplication of selected commands
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hstr_dedup.h"
+
+void dedup_init(SelectionDedup *dedup)
+{
+    dedup->interned=false;
+    dedup->bits=NULL;
+    dedup->stamps=NULL;
+    dedup->words=0;
+    dedup->generation=0;
+}
+
+static void dedup_release_interned(SelectionDedup *dedup)
+{
+    if(dedup->interned) {
+        intern_destroy(&dedup->commands);
+        arena_release(&dedup->copies);
+        dedup->interned=false;
+    }
+}
+
+// new selection - commands interned by the previous one are released
+void dedup_begin(SelectionDedup *dedup)
+{
+    dedup_release_interned(dedup);
+    if(!++dedup->generation) {
+        // stamps of the very first generations would be taken as current ones
+        memset(dedup->stamps, 0, sizeof(unsigned) * dedup->words);
+        dedup->generation=1;
+    }
+}
+
+// id of command which has no dense id - equal commands get the same id in one selection
+unsigned dedup_intern(SelectionDedup *dedup, const char *command, unsigned length)
+{
+    if(!dedup->interned) {
+        intern_init(&dedup->commands, ARENA_SELECTION);
+        arena_init(&dedup->copies, ARENA_SELECTION);
+        dedup->interned=true;
+    }
+    // command is copied as its page may be released while it's still interned
+    unsigned hash=hashmap_hash(command, length), id=intern_lookup_hashed(&dedup->commands, command, length, hash);
+    if(id==INTERN_ID_NONE) {
+        char *copy=arena_alloc(&dedup->copies, length+1);
+        memcpy(copy, command, length+1);
+        id=intern_id_hashed(&dedup->commands, copy, length, hash);
+    }
+    return id;
+}
+
+// true if the command of id was not added in this selection yet
+bool dedup_add(SelectionDedup *dedup, unsigned id)
+{
+    size_t word=id/64;
+    if(word>=dedup->words) {
+        size_t words=dedup->words?dedup->words:16;
+        while(words<=word) {
+            words*=2;
+        }
+        dedup->bits=realloc(dedup->bits, sizeof(uint64_t) * words);
+        dedup->stamps=realloc(dedup->stamps, sizeof(unsigned) * words);
+        memset(dedup->stamps+dedup->words, 0, sizeof(unsigned) * (words-dedup->words));
+        dedup->words=words;
+    }
+    if(dedup->stamps[word]!=dedup->generation) {
+        dedup->stamps[word]=dedup->generation;
+        dedup->bits[word]=0;
+    }
+    uint64_t bit=(uint64_t)1<<(id%64);
+    if(dedup->bits[word]&bit) {
+        return false;
+    }
+    dedup->bits[word]|=bit;
+    return true;
+}
+
+void dedup_destroy(SelectionDedup *dedup)
+{
+    dedup_release_interned(dedup);
+    free(dedup->bits);
+    free(dedup->stamps);
+    dedup->bits=NULL;
+    dedup->stamps=NULL;
+    dedup->words=0;
+}
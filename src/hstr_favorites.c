@@ -31,7 +31,9 @@ void favorites_init(FavoriteItems* favorites)
     favorites->count=0;
     favorites->loaded=false;
     favorites->set=malloc(sizeof(HashSet));
-    hashset_init(favorites->set);
+    // set borrows favorite items
+    hashset_init_borrowed(favorites->set, ARENA_FAVORITES);
+    arena_init(&favorites->arena, ARENA_FAVORITES);
 }
 
 void favorites_show(FavoriteItems *favorites)
@@ -86,13 +88,17 @@ void favorites_get(FavoriteItems* favorites)
                 favorites->items = malloc(sizeof(char*) * favorites->count);
                 favorites->count = 0;
                 char* pb=fileContent, *pe, *s;
+                unsigned length, hash;
                 pe=strchr(fileContent, '\n');
                 while(pe!=NULL) {
                     *pe=0;
-                    if(!hashset_contains(favorites->set,pb)) {
-                        s=hstr_strdup(pb);
+                    // favorite is hashed once for both lookup and insertion
+                    length=pe-pb;
+                    hash=hashmap_hash(pb, length);
+                    if(!hashset_contains_hashed(favorites->set, pb, length, hash)) {
+                        s=arena_strdup(&favorites->arena, pb);
                         favorites->items[favorites->count++]=s;
-                        hashset_add(favorites->set,s);
+                        hashset_put_hashed(favorites->set, s, length, hash, "nil");
                     }
                     pb=pe+1;
                     pe=strchr(pb, '\n');
@@ -135,18 +141,19 @@ void favorites_save(FavoriteItems* favorites)
 
 void favorites_add(FavoriteItems* favorites, char* newFavorite)
 {
+    char *item=arena_strdup(&favorites->arena, newFavorite);
     if(favorites->count) {
         favorites->items=realloc(favorites->items, sizeof(char*) * ++favorites->count);
-        favorites->items[favorites->count-1]=hstr_strdup(newFavorite);
+        favorites->items[favorites->count-1]=item;
         favorites_choose(favorites, newFavorite);
     } else {
         favorites->items=malloc(sizeof(char*));
-        favorites->items[0]=hstr_strdup(newFavorite);
+        favorites->items[0]=item;
         favorites->count=1;
     }
 
     favorites_save(favorites);
-    hashset_add(favorites->set, newFavorite);
+    hashset_add(favorites->set, item);
 }
 
 void favorites_choose(FavoriteItems* favorites, char* choice)
@@ -196,12 +203,9 @@ bool favorites_remove(FavoriteItems* favorites, char* almostDead)
 void favorites_destroy(FavoriteItems* favorites)
 {
     if(favorites) {
-        // TODO hashset destroys keys - no need to destroy items!
-        int i;
-        for(i=0; i<favorites->count; i++) {
-            free(favorites->items[i]);
-        }
-        // TODO hashset destroys keys - no need to destroy items!
+        // items (including removed ones) are released at once
+        arena_release(&favorites->arena);
+        free(favorites->items);
         hashset_destroy(favorites->set, false);
         free(favorites->set);
         free(favorites);
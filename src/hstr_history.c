@@ -16,38 +16,103 @@
  limitations under the License.
 */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <ctype.h>
 #include <limits.h>
+#include <pthread.h>
+#include <glob.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <readline/history.h>
 #include "include/hstr_history.h"
-#include "include/hstr_regexp.h"
+#include "include/hstr_casefold.h"
+#include "include/hstr_index.h"
+#include "include/hstr_intern.h"
+#include "include/hstr_lexer.h"
+#include "include/hstr_rankmap.h"
 
 #define NDEBUG
-#include <assert.h>
 
 typedef struct {
     char *item;
     unsigned rank;
+    unsigned lastOccurrence;
+    // item length and hash are computed once and cached in history items
+    unsigned length;
+    unsigned hash;
 } RankedHistoryItem;
 
+// ranked items stored in slots of rank map
+HASHMAP_DECLARE(RankMap, RankedHistoryItem)
+HASHMAP_DEFINE(RankMap, rankmap)
+
 static HistoryItems *prioritizedHistory;
 static bool dirty;
 
-#ifdef DEBUG_RADIX
-#define DEBUG_RADIXSORT() radixsort_stat(&rs, false); exit(0)
-#else
-#define DEBUG_RADIXSORT()
-#endif
+// history file mapped to memory - history items point to lines in this buffer
+static char *historyFileBuffer;
+static size_t historyFileBufferSize;
 
-// TODO make this configurable from command line as option
-#define METRICS_LOGARITHM(RANK,ORDER,LENGTH) RANK+(log(ORDER)*10.0)+LENGTH
-#define METRICS_ADDITIVE(RANK,ORDER,LENGTH)  RANK+ORDER/10+LENGTH
+// history source (file) which is merged with other sources to one history
+typedef struct {
+    char *fileName;
+    int format;
+    // file mapped to memory
+    char *buffer;
+    size_t size;
+    // records lexed from the file
+    char **lines;
+    unsigned *timestamps;
+    unsigned length;
+} HistorySource;
 
-unsigned history_ranking_function(unsigned rank, int newOccurenceOrder, size_t length) {
-    long metrics=METRICS_LOGARITHM(rank, newOccurenceOrder, length);
-    assert(metrics<UINT_MAX);
-    return metrics;
-}
+// history sources mapped to memory - merged history items point to lines in their buffers
+static HistorySource *historySources;
+static unsigned historySourceCount;
+// corpus of prioritized history is either packed in memory or mapped index file
+static bool historyCorpusPacked;
+// readline's in-memory history is loaded only when the fast loader can't be used or on delete
+static bool systemHistoryLoaded;
+
+// history files bigger than chunk size are ranked by multiple threads
+#define HISTORY_PARALLEL_CHUNK_SIZE (1<<20)
+#define HISTORY_PARALLEL_MAX_THREADS 64
+// id of a line which is not ranked (timestamp or blacklisted item)
+#define HISTORY_LINE_SKIPPED UINT_MAX
+// timestamp of lines in a chunk before its first timestamp is known after preceding chunks are parsed
+#define HISTORY_TIMESTAMP_INHERITED UINT_MAX
+// memory budget mode: raw history page size and count-min sketch of command ranks
+#define HISTORY_RAW_PAGE_SIZE (1<<16)
+#define HISTORY_SKETCH_DEPTH 4
+#define HISTORY_SKETCH_WIDTH (1<<16)
+// history not loaded within the delay is shown provisionally from the tail of the file
+#define HISTORY_PROGRESSIVE_DELAY_MS 100
+#define HISTORY_PROGRESSIVE_TAIL_SIZE (1<<20)
+
+// history loaded in background while provisional history (of the file tail) is shown
+typedef struct {
+    int ranking;
+    HashSet *blacklist;
+    bool memoryBudget;
+} HistoryLoaderJob;
+
+static HistoryItems *provisionalHistory;
+static HistoryLoaderJob historyLoaderJob;
+static pthread_t historyLoader;
+static bool historyLoaderStarted;
+static bool historyLoaderDone;
+static pthread_mutex_t historyLoaderMutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t historyLoaderCondition=PTHREAD_COND_INITIALIZER;
+
+// history ranked from the history file (or its appended lines) whose index isn't saved yet
+static HistoryItems *historyIndexItems;
+static HistoryIndexState historyIndexState;
+static struct stat historyIndexStat;
+static unsigned historyIndexFingerprint;
 
 char *get_history_file_name()
 {
@@ -63,6 +128,7 @@ char *get_history_file_name()
 void dump_prioritized_history(HistoryItems *historyItems)
 {
     printf("\n\nPrioritized history:");
+    history_rank_items(historyItems, historyItems->count);
     int i;
     for(i=0; i<historyItems->count; i++) {
         if(historyItems->items[i]!=NULL) {
@@ -74,138 +140,1751 @@ void dump_prioritized_history(HistoryItems *historyItems)
     printf("\n"); fflush(stdout);
 }
 
-int get_item_offset()
+int get_history_format()
 {
     if(isZshParentShell()) {
-        // In zsh history file, the format of item is
-        // [:][blank][unix_timestamp][:][0][;][cmd]
-        // Such as:
+        // zsh history file items may have extended history header, be metafied and span multiple lines:
         // : 1420549651:0;ls /tmp/b
-        // And the limit of unix timestamp 9999999999 is 2289/11/21,
-        // so we could skip first 15 chars in every zsh history item to get the cmd.
-        return ZSH_HISTORY_ITEM_OFFSET;
+        return HISTORY_FORMAT_ZSH;
     } else {
-        return BASH_HISTORY_ITEM_OFFSET;
+        return HISTORY_FORMAT_BASH;
+    }
+}
+
+void history_mgmt_load_system_history()
+{
+    if(!systemHistoryLoaded) {
+        using_history();
+        char *historyFile = get_history_file_name();
+        if(read_history(historyFile)!=0) {
+            fprintf(stderr, "\nUnable to read history file from '%s'!\n",historyFile);
+            exit(EXIT_FAILURE);
+        }
+        systemHistoryLoaded=true;
     }
 }
 
-HistoryItems *get_prioritized_history(int optionBigKeys, HashSet *blacklist)
+/*
+ * Maps history file to memory as private copy-on-write mapping so that lines can
+ * be split in place w/o copying. Size of the indexable prefix of the file is
+ * calculated and, if the file is to be indexed, its checksum is continued from
+ * the (already validated) prefix of given offset before the content is modified.
+ */
+static char *history_map_file(const char *fileName, size_t offset, struct stat *fileStat, HistoryIndexState *state,
+        bool indexable)
 {
-    using_history();
+    int fd=open(fileName, O_RDONLY);
+    if(fd<0) {
+        return NULL;
+    }
+    if(fstat(fd, fileStat) || !S_ISREG(fileStat->st_mode) || fileStat->st_size<=0 || fileStat->st_size<offset) {
+        close(fd);
+        return NULL;
+    }
+    size_t size=fileStat->st_size;
+    char *buffer=mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(buffer==MAP_FAILED) {
+        return NULL;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(buffer+offset-offset%getpagesize(), size-offset+offset%getpagesize(), MADV_SEQUENTIAL);
+#endif
 
-    char *historyFile = get_history_file_name();
-    if(read_history(historyFile)!=0) {
-        fprintf(stderr, "\nUnable to read history file from '%s'!\n",historyFile);
-        exit(EXIT_FAILURE);
+    char *lastEol=memrchr(buffer, '\n', size);
+    state->indexedSize=lastEol?lastEol-buffer+1:0;
+    if(indexable) {
+        state->indexedWords=history_index_checksum_words(state->indexedWords, buffer, offset, state->indexedSize);
+        state->indexedChecksum=history_index_checksum_finish(state->indexedWords, buffer, state->indexedSize);
     }
+    state->hasTimestamps=size>1 && buffer[0]=='#' && isdigit((unsigned char)buffer[1]);
+    return buffer;
+}
+
+char *history_mmap(const char *fileName, size_t offset, struct stat *fileStat, HistoryIndexState *state)
+{
+    char *buffer=history_map_file(fileName, offset, fileStat, state, true);
+    if(buffer) {
+        historyFileBuffer=buffer;
+        historyFileBufferSize=fileStat->st_size;
+    }
+    return buffer;
+}
+
+/*
+ * Lexes mapped history to records in place (see history_lexer_next()). Records which
+ * are entries of readline history, but not commands, are NULL. Every record gets the
+ * timestamp in effect - it's carried in and out so that history can be lexed in parts.
+ */
+void history_lex_records(char *begin, char *end, bool hasTimestamps, int format,
+        char ***lines, unsigned **timestamps, unsigned *length, unsigned *timestamp)
+{
+    unsigned capacity=(end-begin)/32+16, count=0;
+    char **result=malloc(sizeof(char*) * capacity);
+    unsigned *resultTimestamps=malloc(sizeof(unsigned) * capacity);
+    HistoryLexer lexer;
+    HistoryRecord record;
+    history_lexer_init(&lexer, begin, end, format, hasTimestamps, *timestamp);
+    while(history_lexer_next(&lexer, &record)) {
+        if(count==capacity) {
+            capacity*=2;
+            result=realloc(result, sizeof(char*) * capacity);
+            resultTimestamps=realloc(resultTimestamps, sizeof(unsigned) * capacity);
+        }
+        resultTimestamps[count]=record.timestamp;
+        result[count++]=record.command;
+    }
+    *lines=result;
+    *timestamps=resultTimestamps;
+    *length=count;
+    *timestamp=lexer.timestamp;
+}
+
+// records after offset are lexed - prefix of the file is expected to be indexed
+bool history_mmap_lines(const char *fileName, size_t offset, int format, struct stat *fileStat, HistoryIndexState *state,
+        char ***lines, unsigned **timestamps, unsigned *length)
+{
+    char *buffer=history_mmap(fileName, offset, fileStat, state);
+    if(buffer) {
+        history_lex_records(buffer+offset, buffer+fileStat->st_size, state->hasTimestamps, format,
+                lines, timestamps, length, &state->lastTimestamp);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Readline based fallback used when history file cannot be mapped to memory. Lines are
+ * owned (and written on delete) by readline > zsh commands are not unmetafied.
+ */
+void history_readline_lines(int format, char ***lines, unsigned **timestamps, unsigned *length)
+{
+    history_mgmt_load_system_history();
     HISTORY_STATE *historyState=history_get_history_state();
+    HIST_ENTRY **historyList=history_list();
+    char **result=malloc(sizeof(char*) * (historyState->length?historyState->length:1));
+    unsigned *resultTimestamps=malloc(sizeof(unsigned) * (historyState->length?historyState->length:1));
+    unsigned timestamp=0;
+    int i;
+    for(i=0; i<historyState->length; i++) {
+        result[i]=historyList[i]->line;
+        if(history_get_time(historyList[i])) {
+            timestamp=history_get_time(historyList[i]);
+        }
+        if(history_lexer_bash_timestamp(result[i], &timestamp)) {
+            result[i]=NULL;
+        } else if(format==HISTORY_FORMAT_ZSH) {
+            result[i]=history_lexer_zsh_command(result[i], &timestamp);
+        }
+        resultTimestamps[i]=timestamp;
+    }
+    *lines=result;
+    *timestamps=resultTimestamps;
+    *length=historyState->length;
+}
 
-    int itemOffset = get_item_offset();
-
-    if(historyState->length > 0) {
-        HashSet rankmap;
-        hashset_init(&rankmap);
-
-        int i;
-        RadixSorter rs;
-        unsigned radixMaxKeyEstimate=historyState->size*1000;
-        radixsort_init(&rs, (radixMaxKeyEstimate<100000?100000:radixMaxKeyEstimate));
-        rs.optionBigKeys=optionBigKeys;
-
-        regex_t regexp;
-        // HISTTIMEFORMAT defined > ^#1234567890$
-        const char *histtimeformatTimestamp = "^#[[:digit:]]\\{10,\\}$";
-        regexp_compile(&regexp, histtimeformatTimestamp);
-
-        RankedHistoryItem *r;
-        RadixItem *radixItem;
-        HIST_ENTRY **historyList=history_list();
-        char **rawHistory=malloc(sizeof(char*) * historyState->length);
-        int rawOffset=historyState->length-1, rawTimestamps=0;
-        char *line;
-        for(i=0; i<historyState->length; i++, rawOffset--) {
-            if(!regexp_match(&regexp, historyList[i]->line)) {
-                rawHistory[rawOffset]=0;
-                rawTimestamps++;
-                continue;
+// ranks are set once all items are ordered
+static void history_set_ranks(HistoryItems *history)
+{
+    unsigned i;
+    history->ranks=malloc(sizeof(unsigned) * (history->count?history->count:1));
+    for(i=0; i<history->count; i++) {
+        history->ranks[i]=history->rankKeys[i]>>32;
+    }
+}
+
+/*
+ * Ranked items whose ranks are already final are sorted to history items by rank keys.
+ * Ties are ordered by last occurrence (descending) as if items were ranked one history
+ * line after another > rank and last occurrence are sorted as one key. Only top items
+ * are selected and sorted, the rest is sorted when it's needed (see history_rank_items()).
+ * Ranked items are owned by the caller.
+ */
+static void history_sort_ranked(RankedHistoryItem **ranked, unsigned rankedCount, HistoryItems *history)
+{
+    uint64_t *keys=malloc(sizeof(uint64_t) * (rankedCount?rankedCount:1));
+    unsigned i, top=MIN(rankedCount, HISTORY_RANKED_TOP);
+    for(i=0; i<rankedCount; i++) {
+        keys[i]=(uint64_t)ranked[i]->rank<<32 | ranked[i]->lastOccurrence;
+    }
+    radixsort_select(keys, (void**)ranked, rankedCount, top);
+    radixsort_sort(keys, (void**)ranked, top);
+
+    history->count=rankedCount;
+    history->rankedCount=top;
+    history->rankKeys=keys;
+    history->ranks=NULL;
+    history->items=malloc(sizeof(char*) * (rankedCount?rankedCount:1));
+    history->lengths=malloc(sizeof(unsigned) * (rankedCount?rankedCount:1));
+    history->hashes=malloc(sizeof(unsigned) * (rankedCount?rankedCount:1));
+    for(i=0; i<rankedCount; i++) {
+        history->items[i]=ranked[i]->item;
+        history->lengths[i]=ranked[i]->length;
+        history->hashes[i]=ranked[i]->hash;
+    }
+    if(top==rankedCount) {
+        history_set_ranks(history);
+    }
+    free(ranked);
+}
+
+// top items of the rest are selected and sorted
+static void history_sort_rest(HistoryItems *history, unsigned top)
+{
+    unsigned i, j, ordered=history->rankedCount, rest=history->count-ordered;
+    if(rest) {
+        // lengths and hashes are sorted along with items > items are sorted as their positions
+        void **positions=malloc(sizeof(void*) * rest);
+        for(i=0; i<rest; i++) {
+            positions[i]=(void*)(uintptr_t)(ordered+i);
+        }
+        radixsort_select(history->rankKeys+ordered, positions, rest, top);
+        radixsort_sort(history->rankKeys+ordered, positions, top);
+        char **items=malloc(sizeof(char*) * rest);
+        unsigned *lengths=malloc(sizeof(unsigned) * rest);
+        unsigned *hashes=malloc(sizeof(unsigned) * rest);
+        for(i=0; i<rest; i++) {
+            j=(uintptr_t)positions[i];
+            items[i]=history->items[j];
+            lengths[i]=history->lengths[j];
+            hashes[i]=history->hashes[j];
+        }
+        memcpy(history->items+ordered, items, sizeof(char*) * rest);
+        memcpy(history->lengths+ordered, lengths, sizeof(unsigned) * rest);
+        memcpy(history->hashes+ordered, hashes, sizeof(unsigned) * rest);
+        free(positions);
+        free(items);
+        free(lengths);
+        free(hashes);
+    }
+    history->rankedCount=ordered+top;
+    if(history->rankedCount==history->count) {
+        history_set_ranks(history);
+    }
+}
+
+/*
+ * Items are ordered only as far as they're consumed. Every step multiplies ordered items
+ * (see HISTORY_RANKED_GROWTH) i.e. scan of all items orders them in a few passes over the rest.
+ */
+void history_rank_items(HistoryItems *history, unsigned count)
+{
+    if(history->rankKeys && count>history->rankedCount) {
+        unsigned ordered=history->rankedCount;
+        history_sort_rest(history, MIN(MAX(count, HISTORY_RANKED_GROWTH*ordered), history->count)-ordered);
+    }
+}
+
+/*
+ * Continues ranking of history from the index state with lines appended to the
+ * history file since it was indexed. The result is the same as if whole history
+ * file was ranked: ranks are updated with the same ranking function and ties are
+ * ordered by last occurrence.
+ */
+static HistoryItems *history_rank_appended(
+        char **lines, unsigned *timestamps, unsigned length,
+        HistoryIndexState *state,
+        HistoryItems *indexed,
+        int ranking, HashSet *blacklist)
+{
+    // ranked items point to stable lines of indexed corpus and history file
+    RankMap rankmap;
+    rankmap_init(&rankmap, ARENA_RANKING, true);
+
+    unsigned i, lineLength, lineHash;
+    bool added;
+    RankedHistoryItem *r;
+    for(i=0; i<indexed->count; i++) {
+        r=&rankmap_put_hashed(&rankmap, indexed->items[i], indexed->lengths[i], indexed->hashes[i], &added)->value;
+        r->item=indexed->items[i];
+        r->rank=state->ranks[i];
+        r->lastOccurrence=state->lastOccurrences[i];
+        r->length=indexed->lengths[i];
+        r->hash=indexed->hashes[i];
+    }
+
+    char **rawHistory=malloc(sizeof(char*) * (length+indexed->rawCount));
+    unsigned *rawTimestamps=malloc(sizeof(unsigned) * (length+indexed->rawCount+1));
+    unsigned rawOffset=0, order=state->lineCount;
+    char *line;
+    for(i=length; i>0; i--) {
+        if(lines[i-1]) {
+            rawTimestamps[rawOffset]=timestamps[i-1];
+            rawHistory[rawOffset++]=lines[i-1];
+        }
+    }
+    memcpy(rawHistory+rawOffset, indexed->rawItems, sizeof(char*) * indexed->rawCount);
+    memcpy(rawTimestamps+rawOffset, indexed->rawTimestamps, sizeof(unsigned) * indexed->rawCount);
+#define HISTORY_RANK_APPENDED(RANK) \
+    for(i=0; i<length; i++, order++) { \
+        if((line=lines[i])==NULL) { \
+            continue; \
+        } \
+        lineHash=hashmap_hash_string(line, &lineLength); \
+        if(hashset_contains_hashed(blacklist, line, lineLength, lineHash)) { \
+            continue; \
+        } \
+        r=&rankmap_put_hashed(&rankmap, line, lineLength, lineHash, &added)->value; \
+        if(added) { \
+            r->rank=RANK(0, order, timestamps[i], lineLength); \
+            r->item=line; \
+            r->length=lineLength; \
+            r->hash=lineHash; \
+        } else { \
+            r->rank=RANK(r->rank, order, timestamps[i], lineLength); \
+        } \
+        r->lastOccurrence=order; \
+    }
+    RANKING_SPECIALIZE(ranking, HISTORY_RANK_APPENDED);
+
+    unsigned rankedCount=0, position=0;
+    RankMapSlot *slot;
+    RankedHistoryItem **ranked=malloc(sizeof(RankedHistoryItem*) * (rankmap.currentSize?rankmap.currentSize:1));
+    while((slot=rankmap_next(&rankmap, &position))!=NULL) {
+        ranked[rankedCount++]=&slot->value;
+    }
+
+    HistoryItems *history=malloc(sizeof(HistoryItems));
+    history->rawPages=NULL;
+    history->rawItems=rawHistory;
+    history->rawTimestamps=rawTimestamps;
+    history->rawCount=rawOffset+indexed->rawCount;
+    state->lineCount=order;
+    history_sort_ranked(ranked, rankedCount, history);
+    rankmap_destroy(&rankmap);
+    return history;
+}
+
+/*
+ * Parallel ranking of big history files: the file is split to chunks at line boundaries,
+ * chunks are parsed concurrently to items and chunk local unique items, local uniques are
+ * merged serially to global ids and ranks are then folded concurrently - each thread owns
+ * items whose id modulo thread count is its number and folds the ranking function over
+ * their occurrences in history order. Result is the same as if ranked by single thread.
+ */
+typedef struct {
+    // chunk of mapped history file and parser configuration
+    char *begin;
+    char *end;
+    bool hasTimestamps;
+    int format;
+    HashSet *blacklist;
+    // timestamp in effect at the end of the chunk or HISTORY_TIMESTAMP_INHERITED
+    unsigned timestamp;
+    // chunk lines (items) with their timestamps and chunk local, later global, unique item ids
+    char **items;
+    unsigned *timestamps;
+    unsigned *ids;
+    unsigned count;
+    unsigned rawCount;
+    // chunk local unique items with ids given in order of their first occurrence
+    InternTable uniques;
+    unsigned *globalIds;
+    // history order of the first chunk line, timestamp inherited from previous chunks and raw history slice
+    unsigned orderBase;
+    unsigned inheritedTimestamp;
+    char **rawHistory;
+    unsigned *rawTimestamps;
+} HistoryChunk;
+
+typedef struct {
+    HistoryChunk *chunks;
+    unsigned chunkCount;
+    unsigned worker;
+    unsigned workers;
+    int ranking;
+    unsigned *ranks;
+    unsigned *lastOccurrences;
+    unsigned *lengths;
+} HistoryRankingJob;
+
+static void *history_chunk_parse(void *arg)
+{
+    HistoryChunk *chunk=arg;
+    history_lex_records(chunk->begin, chunk->end, chunk->hasTimestamps, chunk->format,
+            &chunk->items, &chunk->timestamps, &chunk->count, &chunk->timestamp);
+    chunk->ids=malloc(sizeof(unsigned) * (chunk->count?chunk->count:1));
+    chunk->rawCount=0;
+    intern_init(&chunk->uniques, ARENA_RANKING);
+
+    unsigned i, length, hash;
+    char *line;
+    for(i=0; i<chunk->count; i++) {
+        if((line=chunk->items[i])==NULL) {
+            chunk->ids[i]=HISTORY_LINE_SKIPPED;
+            continue;
+        }
+        chunk->rawCount++;
+        hash=hashmap_hash_string(line, &length);
+        if(hashset_contains_hashed(chunk->blacklist, line, length, hash)) {
+            chunk->ids[i]=HISTORY_LINE_SKIPPED;
+            continue;
+        }
+        chunk->ids[i]=intern_id_hashed(&chunk->uniques, line, length, hash);
+    }
+    return NULL;
+}
+
+/*
+ * Chunk ids are translated to global ids, timestamps of lines preceding the first
+ * timestamp in the chunk are resolved and chunk items are written to raw history
+ * (newest first).
+ */
+static void *history_chunk_globalize(void *arg)
+{
+    HistoryChunk *chunk=arg;
+    unsigned i, raw=chunk->rawCount;
+    for(i=0; i<chunk->count; i++) {
+        if(chunk->timestamps[i]==HISTORY_TIMESTAMP_INHERITED) {
+            chunk->timestamps[i]=chunk->inheritedTimestamp;
+        }
+        if(chunk->items[i]) {
+            chunk->rawTimestamps[--raw]=chunk->timestamps[i];
+            chunk->rawHistory[raw]=chunk->items[i];
+        }
+        if(chunk->ids[i]!=HISTORY_LINE_SKIPPED) {
+            chunk->ids[i]=chunk->globalIds[chunk->ids[i]];
+        }
+    }
+    return NULL;
+}
+
+static void *history_chunk_rank(void *arg)
+{
+    HistoryRankingJob *job=arg;
+    unsigned c, i, id, order;
+#define HISTORY_RANK_CHUNKS(RANK) \
+    for(c=0; c<job->chunkCount; c++) { \
+        HistoryChunk *chunk=&job->chunks[c]; \
+        for(i=0, order=chunk->orderBase; i<chunk->count; i++, order++) { \
+            id=chunk->ids[i]; \
+            if(id!=HISTORY_LINE_SKIPPED && id%job->workers==job->worker) { \
+                job->ranks[id]=RANK(job->ranks[id], order, chunk->timestamps[i], job->lengths[id]); \
+                job->lastOccurrences[id]=order; \
+            } \
+        } \
+    }
+    RANKING_SPECIALIZE(job->ranking, HISTORY_RANK_CHUNKS);
+    return NULL;
+}
+
+// runs function on every argument in its own thread - if thread cannot be created, it's run by the caller
+static void history_run_parallel(void *(*function)(void*), void *args, size_t argSize, unsigned count)
+{
+    pthread_t *threads=malloc(sizeof(pthread_t) * count);
+    bool *started=malloc(sizeof(bool) * count);
+    unsigned i;
+    for(i=0; i<count; i++) {
+        started[i]=!pthread_create(&threads[i], NULL, function, (char*)args+i*argSize);
+        if(!started[i]) {
+            function((char*)args+i*argSize);
+        }
+    }
+    for(i=0; i<count; i++) {
+        if(started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(started);
+    free(threads);
+}
+
+// number of threads to be used to rank history file of given size (1 > rank serially)
+static unsigned history_parallelism(size_t size)
+{
+    long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads=size/HISTORY_PARALLEL_CHUNK_SIZE;
+    if(cpus<threads) {
+        threads=cpus<1?1:cpus;
+    }
+    if(threads>HISTORY_PARALLEL_MAX_THREADS) {
+        threads=HISTORY_PARALLEL_MAX_THREADS;
+    }
+    return threads<1?1:threads;
+}
+
+static HistoryItems *history_rank_parallel(
+        char *buffer, size_t size,
+        unsigned threads,
+        HistoryIndexState *state,
+        int format, int ranking, HashSet *blacklist)
+{
+    HistoryChunk *chunks=calloc(threads, sizeof(HistoryChunk));
+    char *begin=buffer, *end=buffer+size;
+    unsigned c, i;
+    for(c=0; c<threads; c++) {
+        chunks[c].begin=begin;
+        chunks[c].end=c==threads-1?end:history_lexer_record_end(begin, MAX(begin, buffer+size/threads*(c+1)), end, format);
+        chunks[c].hasTimestamps=state->hasTimestamps;
+        chunks[c].format=format;
+        chunks[c].blacklist=blacklist;
+        chunks[c].timestamp=c?HISTORY_TIMESTAMP_INHERITED:state->lastTimestamp;
+        begin=chunks[c].end;
+    }
+    history_run_parallel(history_chunk_parse, chunks, sizeof(HistoryChunk), threads);
+
+    // chunk local unique items are merged in history order > ids are given by first occurrence
+    unsigned historyLength=0, rawLength=0;
+    for(c=0; c<threads; c++) {
+        chunks[c].orderBase=historyLength;
+        chunks[c].inheritedTimestamp=c?chunks[c-1].timestamp:state->lastTimestamp;
+        if(chunks[c].timestamp==HISTORY_TIMESTAMP_INHERITED) {
+            chunks[c].timestamp=chunks[c].inheritedTimestamp;
+        }
+        historyLength+=chunks[c].count;
+        rawLength+=chunks[c].rawCount;
+    }
+    InternTable uniques;
+    intern_init(&uniques, ARENA_RANKING);
+    for(c=0; c<threads; c++) {
+        InternTable *chunkUniques=&chunks[c].uniques;
+        chunks[c].globalIds=malloc(sizeof(unsigned) * (chunkUniques->count?chunkUniques->count:1));
+        for(i=0; i<chunkUniques->count; i++) {
+            chunks[c].globalIds[i]=intern_id_hashed(&uniques, intern_string(chunkUniques, i),
+                    intern_length(chunkUniques, i), intern_hash(chunkUniques, i));
+        }
+        intern_destroy(chunkUniques);
+    }
+    unsigned uniqueCount=uniques.count;
+
+    char **rawHistory=malloc(sizeof(char*) * (rawLength?rawLength:1));
+    unsigned *rawTimestamps=malloc(sizeof(unsigned) * (rawLength?rawLength:1));
+    unsigned rawEnd=rawLength;
+    for(c=0; c<threads; c++) {
+        rawEnd-=chunks[c].rawCount;
+        chunks[c].rawHistory=rawHistory+rawEnd;
+        chunks[c].rawTimestamps=rawTimestamps+rawEnd;
+    }
+    history_run_parallel(history_chunk_globalize, chunks, sizeof(HistoryChunk), threads);
+
+    HistoryRankingJob *jobs=malloc(sizeof(HistoryRankingJob) * threads);
+    unsigned *ranks=calloc(uniqueCount?uniqueCount:1, sizeof(unsigned));
+    unsigned *lastOccurrences=malloc(sizeof(unsigned) * (uniqueCount?uniqueCount:1));
+    for(c=0; c<threads; c++) {
+        jobs[c].chunks=chunks;
+        jobs[c].chunkCount=threads;
+        jobs[c].worker=c;
+        jobs[c].workers=threads;
+        jobs[c].ranking=ranking;
+        jobs[c].ranks=ranks;
+        jobs[c].lastOccurrences=lastOccurrences;
+        jobs[c].lengths=uniques.lengths;
+    }
+    history_run_parallel(history_chunk_rank, jobs, sizeof(HistoryRankingJob), threads);
+    free(jobs);
+    state->lastTimestamp=chunks[threads-1].timestamp;
+    for(c=0; c<threads; c++) {
+        free(chunks[c].items);
+        free(chunks[c].timestamps);
+        free(chunks[c].ids);
+        free(chunks[c].globalIds);
+    }
+    free(chunks);
+
+    Arena arena;
+    arena_init(&arena, ARENA_RANKING);
+    RankedHistoryItem **ranked=malloc(sizeof(RankedHistoryItem*) * (uniqueCount?uniqueCount:1));
+    for(i=0; i<uniqueCount; i++) {
+        ranked[i]=arena_alloc(&arena, sizeof(RankedHistoryItem));
+        ranked[i]->item=(char*)intern_string(&uniques, i);
+        ranked[i]->rank=ranks[i];
+        ranked[i]->lastOccurrence=lastOccurrences[i];
+        ranked[i]->length=intern_length(&uniques, i);
+        ranked[i]->hash=intern_hash(&uniques, i);
+    }
+    intern_destroy(&uniques);
+    free(ranks);
+    free(lastOccurrences);
+
+    HistoryItems *history=malloc(sizeof(HistoryItems));
+    history->rawPages=NULL;
+    history->rawItems=rawHistory;
+    history->rawTimestamps=rawTimestamps;
+    history->rawCount=rawLength;
+    state->lineCount=historyLength;
+    history_sort_ranked(ranked, uniqueCount, history);
+    arena_release(&arena);
+    return history;
+}
+
+static void history_munmap()
+{
+    if(historyFileBuffer) {
+        munmap(historyFileBuffer, historyFileBufferSize);
+        historyFileBuffer=NULL;
+    }
+    if(historySources) {
+        unsigned i;
+        for(i=0; i<historySourceCount; i++) {
+            if(historySources[i].buffer) {
+                munmap(historySources[i].buffer, historySources[i].size);
             }
-            if(historyList[i]->line && strlen(historyList[i]->line)>itemOffset) {
-                line=historyList[i]->line+itemOffset;
-            } else {
-                line=historyList[i]->line;
+            free(historySources[i].fileName);
+        }
+        free(historySources);
+        historySources=NULL;
+        historySourceCount=0;
+    }
+}
+
+
+// item is appended to corpus unless it's already there - id of the item (order of its appending) is returned
+static unsigned history_corpus_add(HashSet *packed, char **corpus, size_t *size, size_t *capacity,
+        size_t *offsets, unsigned *ids, char *item, unsigned length, unsigned hash)
+{
+    void *id=hashset_get_hashed(packed, item, length, hash);
+    if(id) {
+        return (uintptr_t)id-1;
+    }
+    while(*size+length+1 > *capacity) {
+        *capacity*=2;
+        *corpus=realloc(*corpus, *capacity);
+    }
+    offsets[*ids]=*size;
+    memcpy(*corpus+*size, item, length+1);
+    *size+=length+1;
+    hashset_put_hashed(packed, item, length, hash, (void*)(uintptr_t)(*ids+1));
+    return (*ids)++;
+}
+
+/*
+ * History items are copied to packed corpus: one contiguous blob of unique items where
+ * ranked items are stored in their current order (top ones in rank order), followed by
+ * raw-only (blacklisted) items. Scan of ranked items is therefore sequential and items
+ * no longer point to history file lines scattered in memory. Items are numbered as
+ * they're packed i.e. ranked item's id is its index and raw items get ids of their commands.
+ */
+static void history_pack_corpus(HistoryItems *history)
+{
+    HashSet packed;
+    hashset_init_borrowed(&packed, ARENA_HISTORY);
+    unsigned i, hash, ids=0, count=history->count, rawCount=history->rawCount;
+    // items beyond the top ranked ones are in slot order of ranking's hash table
+    hashset_reserve(&packed, count);
+    size_t size=0, capacity=1<<16;
+    for(i=0; i<count; i++) {
+        capacity+=history->lengths[i]+1;
+    }
+    char *corpus=malloc(capacity);
+    size_t *offsets=malloc(sizeof(size_t) * (count+rawCount+1));
+    history->rawLengths=malloc(sizeof(unsigned) * (rawCount?rawCount:1));
+    history->rawIds=malloc(sizeof(unsigned) * (rawCount?rawCount:1));
+    // ranked items are packed with lengths and hashes cached by ranking
+    for(i=0; i<count; i++) {
+        history_corpus_add(&packed, &corpus, &size, &capacity, offsets, &ids,
+                history->items[i], history->lengths[i], history->hashes[i]);
+    }
+    for(i=0; i<rawCount; i++) {
+        hash=hashmap_hash_string(history->rawItems[i], &history->rawLengths[i]);
+        history->rawIds[i]=history_corpus_add(&packed, &corpus, &size, &capacity, offsets, &ids,
+                history->rawItems[i], history->rawLengths[i], hash);
+    }
+    hashset_destroy(&packed, false);
+
+    // corpus is reallocated while packed > items are pointed to it once complete
+    for(i=0; i<count; i++) {
+        history->items[i]=corpus+offsets[i];
+    }
+    for(i=0; i<rawCount; i++) {
+        history->rawItems[i]=corpus+offsets[history->rawIds[i]];
+    }
+    free(offsets);
+    history->corpus=corpus;
+    history->corpusSize=size;
+    // case insensitive search scans folded corpus instead of folding items on every comparison
+    history->foldedCorpus=malloc(size?size:1);
+    casefold(history->foldedCorpus, corpus, size);
+}
+
+/*
+ * Copy of packed history whose corpus is packed in the current order of ranked items
+ * (shown history keeps pointing to its corpus). Ranked items are unique i.e. they fill
+ * the beginning of corpus and raw-only items keep their offsets. Ranked items were packed
+ * in the order of their offsets > ids of raw items are mapped by sorting the offsets.
+ */
+static void history_repack_corpus(HistoryItems *history, HistoryItems *packed)
+{
+    unsigned i, id, count=history->count, rawCount=history->rawCount;
+    size_t from, offset=0;
+    uint64_t *keys=malloc(sizeof(uint64_t) * (count?count:1));
+    void **indices=malloc(sizeof(void*) * (count?count:1));
+    for(i=0; i<count; i++) {
+        // keys are sorted in descending order
+        keys[i]=history->corpusSize-(history->items[i]-history->corpus);
+        indices[i]=(void*)(uintptr_t)i;
+    }
+    radixsort_sort(keys, indices, count);
+
+    *packed=*history;
+    packed->items=malloc(sizeof(char*) * (count?count:1));
+    packed->rawItems=malloc(sizeof(char*) * (rawCount?rawCount:1));
+    packed->rawIds=malloc(sizeof(unsigned) * (rawCount?rawCount:1));
+    packed->corpus=malloc(history->corpusSize?history->corpusSize:1);
+    packed->foldedCorpus=malloc(history->corpusSize?history->corpusSize:1);
+    for(i=0; i<count; i++) {
+        from=history->items[i]-history->corpus;
+        memcpy(packed->corpus+offset, history->corpus+from, history->lengths[i]+1);
+        memcpy(packed->foldedCorpus+offset, history->foldedCorpus+from, history->lengths[i]+1);
+        packed->items[i]=packed->corpus+offset;
+        offset+=history->lengths[i]+1;
+    }
+    memcpy(packed->corpus+offset, history->corpus+offset, history->corpusSize-offset);
+    memcpy(packed->foldedCorpus+offset, history->foldedCorpus+offset, history->corpusSize-offset);
+    for(i=0; i<rawCount; i++) {
+        id=history->rawIds[i];
+        if(id<count) {
+            id=(uintptr_t)indices[id];
+            packed->rawItems[i]=packed->items[id];
+        } else {
+            packed->rawItems[i]=packed->corpus+(history->rawItems[i]-history->corpus);
+        }
+        packed->rawIds[i]=id;
+    }
+    free(keys);
+    free(indices);
+}
+
+// case folded copy of item stored in corpus, NULL if item is not in corpus (e.g. paged raw item)
+char *history_folded_item(HistoryItems *history, char *item)
+{
+    if(history->foldedCorpus && item>=history->corpus && item<history->corpus+history->corpusSize) {
+        return history->foldedCorpus+(item-history->corpus);
+    }
+    return NULL;
+}
+
+/*
+ * Ranked history is packed and its sources released. Index (if history file is mappable)
+ * is saved once history is shown (see history_save_index()) as it needs all items ordered.
+ */
+static HistoryItems *history_complete(HistoryItems *history, HistoryIndexState *state,
+        const struct stat *historyStat, unsigned fingerprint, bool indexable)
+{
+    history_pack_corpus(history);
+    historyCorpusPacked=true;
+    if(indexable) {
+        historyIndexItems=history;
+        historyIndexState=*state;
+        historyIndexStat=*historyStat;
+        historyIndexFingerprint=fingerprint;
+    }
+    history_index_close();
+    history_munmap();
+    return history;
+}
+
+// index of ranked history waits to be saved (not while loader may still rank history)
+bool history_index_pending()
+{
+    return !historyLoaderStarted && historyIndexItems;
+}
+
+void history_save_index()
+{
+    if(!history_index_pending()) {
+        return;
+    }
+    HistoryItems *history=historyIndexItems;
+    historyIndexItems=NULL;
+    // index stores items in their final order
+    history_rank_items(history, history->count);
+    unsigned i;
+    historyIndexState.ranks=history->ranks;
+    historyIndexState.lastOccurrences=malloc(sizeof(unsigned) * (history->count?history->count:1));
+    for(i=0; i<history->count; i++) {
+        historyIndexState.lastOccurrences[i]=(unsigned)history->rankKeys[i];
+    }
+    free(history->rankKeys);
+    history->rankKeys=NULL;
+
+    // corpus was packed before the rest was ordered > index gets its copy in rank order
+    HistoryItems packed;
+    history_repack_corpus(history, &packed);
+    history_index_save(&historyIndexStat, historyIndexFingerprint, &historyIndexState, &packed);
+    free(packed.items);
+    free(packed.rawItems);
+    free(packed.rawIds);
+    free(packed.corpus);
+    free(packed.foldedCorpus);
+    free(historyIndexState.lastOccurrences);
+}
+
+static void history_items_free(HistoryItems *history)
+{
+    free(history->items);
+    free(history->lengths);
+    free(history->hashes);
+    free(history->ranks);
+    free(history->rankKeys);
+    free(history->rawItems);
+    free(history->rawLengths);
+    free(history->rawTimestamps);
+    free(history->rawIds);
+}
+
+/*
+ * History files matching (colon separated) glob patterns from HH_HISTORY_SOURCES
+ * followed by history file - sources with the same timestamps are merged in this
+ * order i.e. history file commands are considered to be the most recent ones.
+ */
+static char **history_source_files(const char *historyFile, unsigned *count)
+{
+    char *patterns=getenv(ENV_VAR_HH_HISTORY_SOURCES);
+    if(!patterns || !strlen(patterns)) {
+        *count=0;
+        return NULL;
+    }
+
+    glob_t globbed;
+    int flags=GLOB_TILDE|GLOB_NOCHECK;
+    char *patternsCopy=strdup(patterns), *savePtr=NULL, *pattern;
+    memset(&globbed, 0, sizeof(globbed));
+    for(pattern=strtok_r(patternsCopy, ":", &savePtr); pattern; pattern=strtok_r(NULL, ":", &savePtr)) {
+        if(!glob(pattern, flags, NULL, &globbed)) {
+            flags|=GLOB_APPEND;
+        }
+    }
+    free(patternsCopy);
+
+    struct stat historyStat, sourceStat;
+    bool historyExists=!stat(historyFile, &historyStat);
+    char **result=malloc(sizeof(char*) * (globbed.gl_pathc+1));
+    unsigned i, j, resultCount=0;
+    for(i=0; i<globbed.gl_pathc; i++) {
+        if(stat(globbed.gl_pathv[i], &sourceStat) || !S_ISREG(sourceStat.st_mode)) {
+            continue;
+        }
+        // history file and files matched by multiple patterns are merged only once
+        bool duplicate=historyExists && sourceStat.st_dev==historyStat.st_dev && sourceStat.st_ino==historyStat.st_ino;
+        for(j=0; j<i && !duplicate; j++) {
+            duplicate=!strcmp(globbed.gl_pathv[i], globbed.gl_pathv[j]);
+        }
+        if(!duplicate) {
+            result[resultCount++]=strdup(globbed.gl_pathv[i]);
+        }
+    }
+    if(flags&GLOB_APPEND) {
+        globfree(&globbed);
+    }
+    result[resultCount++]=strdup(historyFile);
+    *count=resultCount;
+    return result;
+}
+
+static void *history_source_parse(void *arg)
+{
+    HistorySource *source=arg;
+    struct stat fileStat;
+    HistoryIndexState state;
+    unsigned timestamp=0;
+    source->buffer=history_map_file(source->fileName, 0, &fileStat, &state, false);
+    if(source->buffer) {
+        source->size=fileStat.st_size;
+        history_lex_records(source->buffer, source->buffer+source->size, state.hasTimestamps, source->format,
+                &source->lines, &source->timestamps, &source->length, &timestamp);
+    } else {
+        source->lines=NULL;
+        source->timestamps=NULL;
+        source->length=0;
+    }
+    return NULL;
+}
+
+// record of source a precedes record of source b: the older one goes first, ties in source order
+static bool history_source_precedes(HistorySource *sources, unsigned *positions, unsigned a, unsigned b)
+{
+    unsigned aa=sources[a].timestamps[positions[a]], bb=sources[b].timestamps[positions[b]];
+    return aa<bb || (aa==bb && a<b);
+}
+
+static void history_source_sift_down(HistorySource *sources, unsigned *positions, unsigned *heap, unsigned heapSize, unsigned i)
+{
+    unsigned child, top=heap[i];
+    while((child=2*i+1)<heapSize) {
+        if(child+1<heapSize && history_source_precedes(sources, positions, heap[child+1], heap[child])) {
+            child++;
+        }
+        if(!history_source_precedes(sources, positions, heap[child], top)) {
+            break;
+        }
+        heap[i]=heap[child];
+        i=child;
+    }
+    heap[i]=top;
+}
+
+/*
+ * Records of sources are merged by timestamp using min-heap of sources (k-way merge) -
+ * order of records within a source is kept even if their timestamps are not monotonic.
+ */
+static void history_merge_sources(HistorySource *sources, unsigned count,
+        char ***lines, unsigned **timestamps, unsigned *length)
+{
+    unsigned i, total=0, heapSize=0;
+    unsigned *positions=calloc(count, sizeof(unsigned));
+    unsigned *heap=malloc(sizeof(unsigned) * count);
+    for(i=0; i<count; i++) {
+        total+=sources[i].length;
+        if(sources[i].length) {
+            heap[heapSize++]=i;
+        }
+    }
+    for(i=heapSize/2; i>0; i--) {
+        history_source_sift_down(sources, positions, heap, heapSize, i-1);
+    }
+
+    char **result=malloc(sizeof(char*) * (total?total:1));
+    unsigned *resultTimestamps=malloc(sizeof(unsigned) * (total?total:1));
+    unsigned s, n=0;
+    while(heapSize) {
+        s=heap[0];
+        resultTimestamps[n]=sources[s].timestamps[positions[s]];
+        result[n++]=sources[s].lines[positions[s]++];
+        if(positions[s]==sources[s].length) {
+            heap[0]=heap[--heapSize];
+        }
+        if(heapSize) {
+            history_source_sift_down(sources, positions, heap, heapSize, 0);
+        }
+    }
+    free(positions);
+    free(heap);
+    *lines=result;
+    *timestamps=resultTimestamps;
+    *length=n;
+}
+
+typedef struct {
+    ConcurrentRankMap *rankmap;
+    char **lines;
+    unsigned *timestamps;
+    unsigned begin;
+    unsigned end;
+    int ranking;
+    HashSet *blacklist;
+} HistoryConcurrentJob;
+
+static void *history_concurrent_rank(void *arg)
+{
+    HistoryConcurrentJob *job=arg;
+    unsigned i, length, hash;
+    char *line;
+#define HISTORY_RANK_CONCURRENTLY(RANK) \
+    for(i=job->begin; i<job->end; i++) { \
+        if((line=job->lines[i])==NULL) { \
+            continue; \
+        } \
+        hash=hashmap_hash_string(line, &length); \
+        if(hashset_contains_hashed(job->blacklist, line, length, hash)) { \
+            continue; \
+        } \
+        concurrent_rankmap_add(job->rankmap, line, length, hash, RANK(0, i, job->timestamps[i], length), i); \
+    }
+    RANKING_SPECIALIZE(job->ranking, HISTORY_RANK_CONCURRENTLY);
+    return NULL;
+}
+
+/*
+ * Merged history is split to slices of lines which are ranked by threads to one concurrent
+ * rank map - possible only if ranking accumulates contributions of occurrences. Result is
+ * the same as if ranked by single thread.
+ */
+static HistoryItems *history_rank_concurrently(char **lines, unsigned *timestamps, unsigned length,
+        HistoryIndexState *state, int ranking, HashSet *blacklist, unsigned threads)
+{
+    ConcurrentRankMap *rankmap=concurrent_rankmap_new(ARENA_RANKING);
+    HistoryConcurrentJob *jobs=malloc(sizeof(HistoryConcurrentJob) * threads);
+    unsigned i;
+    for(i=0; i<threads; i++) {
+        jobs[i].rankmap=rankmap;
+        jobs[i].lines=lines;
+        jobs[i].timestamps=timestamps;
+        jobs[i].begin=(uint64_t)length*i/threads;
+        jobs[i].end=(uint64_t)length*(i+1)/threads;
+        jobs[i].ranking=ranking;
+        jobs[i].blacklist=blacklist;
+    }
+    history_run_parallel(history_concurrent_rank, jobs, sizeof(HistoryConcurrentJob), threads);
+    free(jobs);
+    FrozenRankMap frozen;
+    concurrent_rankmap_freeze(rankmap, &frozen);
+    free(rankmap);
+
+    RankedHistoryItem *items=malloc(sizeof(RankedHistoryItem) * (frozen.count?frozen.count:1));
+    RankedHistoryItem **ranked=malloc(sizeof(RankedHistoryItem*) * (frozen.count?frozen.count:1));
+    for(i=0; i<frozen.count; i++) {
+        items[i].item=(char*)frozen.items[i];
+        items[i].rank=frozen.ranks[i];
+        items[i].lastOccurrence=frozen.lastOccurrences[i];
+        items[i].length=frozen.lengths[i];
+        items[i].hash=frozen.hashes[i];
+        ranked[i]=&items[i];
+    }
+    unsigned rankedCount=frozen.count;
+    frozen_rankmap_destroy(&frozen);
+
+    char **rawHistory=malloc(sizeof(char*) * (length?length:1));
+    unsigned *rawTimestamps=malloc(sizeof(unsigned) * (length?length:1));
+    unsigned rawCount=0;
+    for(i=length; i>0; i--) {
+        if(lines[i-1]) {
+            rawTimestamps[rawCount]=timestamps[i-1];
+            rawHistory[rawCount++]=lines[i-1];
+        }
+    }
+
+    HistoryItems *history=malloc(sizeof(HistoryItems));
+    history->rawPages=NULL;
+    history->rawItems=rawHistory;
+    history->rawTimestamps=rawTimestamps;
+    history->rawCount=rawCount;
+    state->lineCount=length;
+    history_sort_ranked(ranked, rankedCount, history);
+    free(items);
+    return history;
+}
+
+/*
+ * History of multiple sources: sources are lexed concurrently, merged by timestamp and
+ * ranked using one rank map i.e. commands are deduplicated across sources. Merged
+ * history is not indexed.
+ */
+static HistoryItems *history_rank_sources(char **files, unsigned count,
+        int format, int ranking, HashSet *blacklist)
+{
+    historySources=calloc(count, sizeof(HistorySource));
+    historySourceCount=count;
+    // one thread per source, at most one per CPU
+    long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned i, batch=cpus<1?1:MIN(cpus, HISTORY_PARALLEL_MAX_THREADS);
+    for(i=0; i<count; i++) {
+        historySources[i].fileName=files[i];
+        historySources[i].format=format;
+    }
+    for(i=0; i<count; i+=batch) {
+        history_run_parallel(history_source_parse, historySources+i, sizeof(HistorySource), MIN(batch, count-i));
+    }
+
+    char **historyLines;
+    unsigned *historyTimestamps, historyLength;
+    history_merge_sources(historySources, count, &historyLines, &historyTimestamps, &historyLength);
+    for(i=0; i<count; i++) {
+        free(historySources[i].lines);
+        free(historySources[i].timestamps);
+    }
+
+    size_t size=0;
+    for(i=0; i<count; i++) {
+        size+=historySources[i].size;
+    }
+    unsigned threads=history_parallelism(size);
+
+    HistoryItems *history=NULL;
+    if(historyLength) {
+        HistoryIndexState state;
+        state.lineCount=0;
+        if(threads>1 && ranking_accumulates(ranking)) {
+            history=history_rank_concurrently(historyLines, historyTimestamps, historyLength,
+                    &state, ranking, blacklist, threads);
+        } else {
+            HistoryItems empty;
+            memset(&empty, 0, sizeof(empty));
+            history=history_rank_appended(historyLines, historyTimestamps, historyLength,
+                    &state, &empty, ranking, blacklist);
+        }
+        history_complete(history, &state, NULL, 0, false);
+    } else {
+        history_munmap();
+    }
+    free(historyLines);
+    free(historyTimestamps);
+    return history;
+}
+
+/*
+ * Memory budget mode: history file is mapped read-only and split to pages which are
+ * lexed to their own copies - ranking pass lexes pages one by one and raw history view
+ * lexes just the pages it shows. Only top ranked commands are kept in memory: ranks of
+ * all commands are estimated by count-min sketch and commands whose estimated rank is
+ * high enough replace the least ranked ones.
+ */
+typedef struct {
+    // ranked item must be the first member - resident items are sorted as ranked items
+    RankedHistoryItem ranked;
+    unsigned heapIndex;
+} ResidentHistoryItem;
+
+typedef struct {
+    int ranking;
+    HashSet *blacklist;
+    unsigned order;
+    unsigned *sketch;
+    // resident commands (keys borrowed from resident items) and min-heap of them by rank
+    HashSet residents;
+    ResidentHistoryItem **heap;
+    unsigned heapSize;
+    // resident items and copies of their commands (reused on eviction)
+    Arena residentArena;
+    Arena commandArena;
+} HistoryBudget;
+
+static void history_budget_swap(HistoryBudget *budget, unsigned i, unsigned j)
+{
+    ResidentHistoryItem *r=budget->heap[i];
+    budget->heap[i]=budget->heap[j];
+    budget->heap[j]=r;
+    budget->heap[i]->heapIndex=i;
+    budget->heap[j]->heapIndex=j;
+}
+
+static void history_budget_sift_up(HistoryBudget *budget, unsigned i)
+{
+    while(i && budget->heap[i]->ranked.rank<budget->heap[(i-1)/2]->ranked.rank) {
+        history_budget_swap(budget, i, (i-1)/2);
+        i=(i-1)/2;
+    }
+}
+
+static void history_budget_sift_down(HistoryBudget *budget, unsigned i)
+{
+    unsigned child;
+    while((child=2*i+1)<budget->heapSize) {
+        if(child+1<budget->heapSize && budget->heap[child+1]->ranked.rank<budget->heap[child]->ranked.rank) {
+            child++;
+        }
+        if(budget->heap[child]->ranked.rank>=budget->heap[i]->ranked.rank) {
+            break;
+        }
+        history_budget_swap(budget, i, child);
+        i=child;
+    }
+}
+
+/*
+ * Sketch cells are folded with the ranking function. Ranking functions only grow with
+ * occurrences, therefore the minimum of command cells never underestimates its rank.
+ */
+static unsigned history_budget_estimate(HistoryBudget *budget, const char *command, unsigned order,
+        unsigned timestamp, size_t length)
+{
+    uint64_t hash=14695981039346656037ull;
+    const char *p;
+    for(p=command; *p; p++) {
+        hash=(hash^(unsigned char)*p)*1099511628211ull;
+    }
+    uint32_t h1=hash, h2=(hash>>32)|1;
+    unsigned i, *cell, result=UINT_MAX;
+    for(i=0; i<HISTORY_SKETCH_DEPTH; i++) {
+        cell=budget->sketch+i*HISTORY_SKETCH_WIDTH+(h1+i*h2)%HISTORY_SKETCH_WIDTH;
+        *cell=ranking_rank(budget->ranking, *cell, order, timestamp, length);
+        result=MIN(result, *cell);
+    }
+    return result;
+}
+
+static void history_budget_add(HistoryBudget *budget, char *command, unsigned timestamp)
+{
+    unsigned order=budget->order++;
+    if(command==NULL) {
+        return;
+    }
+    unsigned length, hash=hashmap_hash_string(command, &length);
+    if(hashset_contains_hashed(budget->blacklist, command, length, hash)) {
+        return;
+    }
+    unsigned rank=history_budget_estimate(budget, command, order, timestamp, length);
+    ResidentHistoryItem *r=hashset_get_hashed(&budget->residents, command, length, hash);
+    if(r) {
+        r->ranked.rank=rank;
+        r->ranked.lastOccurrence=order;
+        history_budget_sift_down(budget, r->heapIndex);
+        return;
+    }
+    if(budget->heapSize==HISTORY_MEMORY_BUDGET_ITEMS) {
+        if(rank<=budget->heap[0]->ranked.rank) {
+            return;
+        }
+        // the least ranked resident command is evicted
+        r=budget->heap[0];
+        hashset_remove(&budget->residents, r->ranked.item);
+        arena_free(&budget->commandArena, r->ranked.item, r->ranked.length+1);
+    } else {
+        r=arena_alloc(&budget->residentArena, sizeof(ResidentHistoryItem));
+        r->heapIndex=budget->heapSize;
+        budget->heap[budget->heapSize++]=r;
+    }
+    r->ranked.item=arena_alloc(&budget->commandArena, length+1);
+    memcpy(r->ranked.item, command, length+1);
+    r->ranked.rank=rank;
+    r->ranked.lastOccurrence=order;
+    r->ranked.length=length;
+    r->ranked.hash=hash;
+    hashset_put_hashed(&budget->residents, r->ranked.item, length, hash, r);
+    history_budget_sift_down(budget, r->heapIndex);
+    history_budget_sift_up(budget, r->heapIndex);
+}
+
+static bool history_pages_map(const char *fileName, HistoryRawPages *pages)
+{
+    int fd=open(fileName, O_RDONLY);
+    if(fd<0) {
+        return false;
+    }
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) || !S_ISREG(fileStat.st_mode) || fileStat.st_size<=0) {
+        close(fd);
+        return false;
+    }
+    pages->size=fileStat.st_size;
+    pages->buffer=mmap(NULL, pages->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(pages->buffer==MAP_FAILED) {
+        pages->buffer=NULL;
+        return false;
+    }
+    pages->hasTimestamps=pages->size>1 && pages->buffer[0]=='#' && isdigit((unsigned char)pages->buffer[1]);
+    return true;
+}
+
+/*
+ * Mapped history file is split to pages and pages are lexed (to scratch copy) one by
+ * one - records are passed to budget ranking (if any) and commands of pages are counted.
+ */
+static void history_pages_scan(HistoryRawPages *pages, HistoryBudget *budget)
+{
+#ifdef MADV_SEQUENTIAL
+    madvise(pages->buffer, pages->size, MADV_SEQUENTIAL);
+#endif
+    unsigned capacity=pages->size/HISTORY_RAW_PAGE_SIZE+1, commands=0, timestamp=0;
+    size_t scratchSize=0;
+    char *scratch=NULL, *begin=pages->buffer, *end=pages->buffer+pages->size;
+    HistoryLexer lexer;
+    HistoryRecord record;
+    HistoryRawPage *page;
+    pages->pages=malloc(sizeof(HistoryRawPage) * capacity);
+    pages->count=0;
+    while(begin<end) {
+        if(pages->count==capacity) {
+            capacity*=2;
+            pages->pages=realloc(pages->pages, sizeof(HistoryRawPage) * capacity);
+        }
+        page=&pages->pages[pages->count++];
+        page->offset=begin-pages->buffer;
+        page->size=history_lexer_record_end(pages->buffer, MIN(begin+HISTORY_RAW_PAGE_SIZE, end-1), end, pages->format)-begin;
+        page->timestamp=timestamp;
+        page->first=commands;
+        page->lexed=NULL;
+        page->items=NULL;
+        if(page->size>scratchSize) {
+            scratchSize=page->size;
+            scratch=realloc(scratch, scratchSize);
+        }
+        memcpy(scratch, begin, page->size);
+        history_lexer_init(&lexer, scratch, scratch+page->size, pages->format, pages->hasTimestamps, timestamp);
+        while(history_lexer_next(&lexer, &record)) {
+            if(budget) {
+                history_budget_add(budget, record.command, record.timestamp);
             }
-            rawHistory[rawOffset]=line;
-            if(hashset_contains(blacklist, line)) {
-                continue;
+            if(record.command) {
+                commands++;
             }
-            if((r=hashset_get(&rankmap, line))==NULL) {
-                r=malloc(sizeof(RankedHistoryItem));
-                r->rank=history_ranking_function(0, i, strlen(line));
-                r->item=historyList[i]->line;
-
-                hashset_put(&rankmap, line, r);
-
-                radixItem=malloc(sizeof(RadixItem));
-                radixItem->key=r->rank;
-                radixItem->data=r;
-                radixItem->next=NULL;
-                radixsort_add(&rs, radixItem);
-            } else {
-                radixItem=radix_cut(&rs, r->rank, r);
+        }
+        page->count=commands-page->first;
+        timestamp=lexer.timestamp;
+        begin+=page->size;
+    }
+    free(scratch);
+    pages->lexed=malloc(sizeof(unsigned) * pages->count);
+    pages->lexedCount=0;
+#ifdef MADV_RANDOM
+    madvise(pages->buffer, pages->size, MADV_RANDOM);
+#endif
+}
 
-                assert(radixItem);
+static void history_page_release(HistoryRawPage *page)
+{
+    free(page->lexed);
+    free(page->items);
+    page->lexed=NULL;
+    page->items=NULL;
+}
 
-                if(radixItem) {
-                    r->rank=history_ranking_function(r->rank, i, strlen(line));
-                    radixItem->key=r->rank;
-                    radixsort_add(&rs, radixItem);
-                }
-            }
+static void history_pages_free(HistoryRawPages *pages)
+{
+    unsigned i;
+    for(i=0; i<pages->lexedCount; i++) {
+        history_page_release(&pages->pages[pages->lexed[i]]);
+    }
+    free(pages->lexed);
+    free(pages->pages);
+    if(pages->buffer) {
+        munmap(pages->buffer, pages->size);
+    }
+}
+
+// raw history item i (the most recent first) - it's valid until released by history_raw_retain()
+char *history_raw_item(HistoryItems *history, unsigned i)
+{
+    if(!history->rawPages) {
+        return history->rawItems[i];
+    }
+    HistoryRawPages *pages=history->rawPages;
+    unsigned n=history->rawCount-1-i, low=0, high=pages->count-1, middle;
+    while(low<high) {
+        middle=(low+high+1)/2;
+        if(pages->pages[middle].first<=n) {
+            low=middle;
+        } else {
+            high=middle-1;
         }
-        if(rawTimestamps) {
-            rawOffset=0;
-            for(i=0; i<historyState->length; i++) {
-                if(rawHistory[i]) {
-                    rawHistory[rawOffset++]=rawHistory[i];
-                }
+    }
+    HistoryRawPage *page=&pages->pages[low];
+    if(!page->lexed) {
+        pages->lexed[pages->lexedCount++]=low;
+        page->lexed=malloc(page->size);
+        memcpy(page->lexed, pages->buffer+page->offset, page->size);
+        page->items=malloc(sizeof(char*) * (page->count?page->count:1));
+        HistoryLexer lexer;
+        HistoryRecord record;
+        unsigned count=0;
+        history_lexer_init(&lexer, page->lexed, page->lexed+page->size, pages->format, pages->hasTimestamps, page->timestamp);
+        while(history_lexer_next(&lexer, &record)) {
+            if(record.command) {
+                page->items[count++]=record.command;
             }
         }
+    }
+    return page->items[n-page->first];
+}
 
-        regfree(&regexp);
+// lexed copy of page w/ its index in the list of lexed pages
+typedef struct {
+    uintptr_t begin;
+    uintptr_t end;
+    unsigned lexed;
+} HistoryLexedPage;
 
-        DEBUG_RADIXSORT();
+static int history_lexed_page_cmp(const void *a, const void *b)
+{
+    uintptr_t x=((const HistoryLexedPage*)a)->begin, y=((const HistoryLexedPage*)b)->begin;
+    return x<y?-1:x>y;
+}
 
-        RadixItem **prioritizedRadix=radixsort_dump(&rs);
-        prioritizedHistory=malloc(sizeof(HistoryItems));
-        prioritizedHistory->count=rs.size;
-        prioritizedHistory->rawCount=historyState->length-rawTimestamps;
-        prioritizedHistory->items=malloc(rs.size * sizeof(char*));
-        prioritizedHistory->rawItems=rawHistory;
-        for(i=0; i<rs.size; i++) {
-            if(prioritizedRadix[i]->data) {
-                char* item = ((RankedHistoryItem *)(prioritizedRadix[i]->data))->item;
-                if(strlen(item)>itemOffset) {
-                    item += itemOffset;
-                }
-                prioritizedHistory->items[i]=item;
+/*
+ * Lexed pages are released unless they contain given items (e.g. selection being shown).
+ * Page of item is bisected in pages ordered by address - consecutive items tend to be
+ * in the same page which is tried first.
+ */
+void history_raw_retain(HistoryItems *history, char **items, unsigned count)
+{
+    if(!history->rawPages) {
+        return;
+    }
+    HistoryRawPages *pages=history->rawPages;
+    if(!pages->lexedCount) {
+        return;
+    }
+    HistoryLexedPage *sorted=malloc(sizeof(HistoryLexedPage) * pages->lexedCount);
+    bool *retained=calloc(pages->lexedCount, sizeof(bool));
+    unsigned i, low, high, middle, lexedCount=0;
+    for(i=0; i<pages->lexedCount; i++) {
+        HistoryRawPage *page=&pages->pages[pages->lexed[i]];
+        sorted[i].begin=(uintptr_t)page->lexed;
+        sorted[i].end=(uintptr_t)page->lexed+page->size;
+        sorted[i].lexed=i;
+    }
+    qsort(sorted, pages->lexedCount, sizeof(HistoryLexedPage), history_lexed_page_cmp);
+    HistoryLexedPage *last=NULL;
+    for(i=0; i<count; i++) {
+        uintptr_t item=(uintptr_t)items[i];
+        if(last && item>=last->begin && item<last->end) {
+            continue;
+        }
+        low=0;
+        high=pages->lexedCount;
+        while(low<high) {
+            middle=(low+high)/2;
+            if(sorted[middle].end<=item) {
+                low=middle+1;
+            } else {
+                high=middle;
             }
-            free(prioritizedRadix[i]->data);
-            free(prioritizedRadix[i]);
         }
+        if(low<pages->lexedCount && item>=sorted[low].begin) {
+            last=&sorted[low];
+            retained[last->lexed]=true;
+        }
+    }
+    for(i=0; i<pages->lexedCount; i++) {
+        if(retained[i]) {
+            pages->lexed[lexedCount++]=pages->lexed[i];
+        } else {
+            history_page_release(&pages->pages[pages->lexed[i]]);
+        }
+    }
+    pages->lexedCount=lexedCount;
+    free(sorted);
+    free(retained);
+}
+
+// history file was rewritten > paged raw history is mapped and split to pages again
+static void history_raw_reload(HistoryItems *history, const char *fileName)
+{
+    HistoryRawPages *pages=history->rawPages;
+    history_pages_free(pages);
+    pages->count=0;
+    pages->pages=NULL;
+    pages->lexed=NULL;
+    pages->lexedCount=0;
+    history->rawCount=0;
+    if(history_pages_map(fileName, pages)) {
+        history_pages_scan(pages, NULL);
+        history->rawCount=pages->pages[pages->count-1].first+pages->pages[pages->count-1].count;
+    } else {
+        pages->buffer=NULL;
+    }
+}
+
+static HistoryItems *history_rank_budget(const char *fileName, int format,
+        int ranking, HashSet *blacklist)
+{
+    HistoryRawPages *pages=malloc(sizeof(HistoryRawPages));
+    pages->format=format;
+    if(!history_pages_map(fileName, pages)) {
+        free(pages);
+        return NULL;
+    }
+
+    HistoryBudget *budget=malloc(sizeof(HistoryBudget));
+    budget->ranking=ranking;
+    budget->blacklist=blacklist;
+    budget->order=0;
+    budget->sketch=calloc(HISTORY_SKETCH_DEPTH*HISTORY_SKETCH_WIDTH, sizeof(unsigned));
+    hashset_init_borrowed(&budget->residents, ARENA_RANKING);
+    budget->heap=malloc(sizeof(ResidentHistoryItem*) * HISTORY_MEMORY_BUDGET_ITEMS);
+    budget->heapSize=0;
+    arena_init(&budget->residentArena, ARENA_RANKING);
+    arena_init(&budget->commandArena, ARENA_HISTORY);
+    history_pages_scan(pages, budget);
+    free(budget->sketch);
+    hashset_destroy(&budget->residents, false);
+
+    unsigned i, rawCount=pages->pages[pages->count-1].first+pages->pages[pages->count-1].count;
+    if(!rawCount) {
+        free(budget->heap);
+        arena_release(&budget->residentArena);
+        arena_release(&budget->commandArena);
+        free(budget);
+        history_pages_free(pages);
+        free(pages);
+        return NULL;
+    }
+    RankedHistoryItem **ranked=malloc(sizeof(RankedHistoryItem*) * (budget->heapSize?budget->heapSize:1));
+    for(i=0; i<budget->heapSize; i++) {
+        ranked[i]=&budget->heap[i]->ranked;
+    }
+    HistoryItems *history=malloc(sizeof(HistoryItems));
+    history_sort_ranked(ranked, budget->heapSize, history);
+    free(budget->heap);
+    arena_release(&budget->residentArena);
+
+    // resident commands are copied to packed corpus
+    history->rawItems=NULL;
+    history->rawTimestamps=NULL;
+    history->rawCount=0;
+    history_pack_corpus(history);
+    historyCorpusPacked=true;
+    arena_release(&budget->commandArena);
+    free(budget);
+    history->rawCount=rawCount;
+    history->rawPages=pages;
+    return history;
+}
+
+HistoryItems *get_prioritized_history(int ranking, HashSet *blacklist, bool memoryBudget)
+{
+    char *historyFile=get_history_file_name();
+    int format=get_history_format();
+
+    if(memoryBudget) {
+        prioritizedHistory=history_rank_budget(historyFile, format, ranking, blacklist);
+        if(prioritizedHistory) {
+            return prioritizedHistory;
+        }
+    }
 
-        radixsort_destroy(&rs);
-        // TODO rankmap (?) and blacklist (?) to be destroyed
+    unsigned sourceCount;
+    char **sources=history_source_files(historyFile, &sourceCount);
+    if(sourceCount>1) {
+        prioritizedHistory=history_rank_sources(sources, sourceCount, format, ranking, blacklist);
+        free(sources);
+        return prioritizedHistory;
+    }
+    if(sources) {
+        free(sources[0]);
+        free(sources);
+    }
 
+    struct stat historyStat;
+    HistoryIndexState state;
+    HistoryItems indexed;
+    unsigned fingerprint=history_index_fingerprint(format, ranking, blacklist);
+    int indexStatus=HH_INDEX_INVALID;
+    if(!stat(historyFile, &historyStat) && S_ISREG(historyStat.st_mode)) {
+        indexStatus=history_index_load(historyFile, &historyStat, fingerprint,
+                &state, &indexed);
+    }
+    // warm start: history file didn't change since it was indexed > corpus is the mapped index
+    if(indexStatus==HH_INDEX_CURRENT) {
+        prioritizedHistory=malloc(sizeof(HistoryItems));
+        *prioritizedHistory=indexed;
+        historyCorpusPacked=false;
         return prioritizedHistory;
+    }
+
+    char **historyLines;
+    unsigned *historyTimestamps;
+    unsigned historyLength;
+    HistoryIndexState newState;
+    if(indexStatus==HH_INDEX_PREFIX) {
+        // history was appended: rank only its tail
+        newState.lastTimestamp=state.lastTimestamp;
+        newState.indexedWords=state.indexedWords;
+        if(history_mmap_lines(historyFile, state.indexedSize, format, &historyStat, &newState,
+                &historyLines, &historyTimestamps, &historyLength)) {
+            newState.lineCount=state.lineCount;
+            newState.ranks=state.ranks;
+            newState.lastOccurrences=state.lastOccurrences;
+            prioritizedHistory=history_rank_appended(
+                    historyLines, historyTimestamps, historyLength,
+                    &newState,
+                    &indexed,
+                    ranking, blacklist);
+            free(historyLines);
+            free(historyTimestamps);
+            history_items_free(&indexed);
+            return history_complete(prioritizedHistory, &newState, &historyStat, fingerprint, true);
+        }
+        history_items_free(&indexed);
+        history_index_close();
+    }
+
+    newState.lastTimestamp=0;
+    newState.indexedWords=HH_INDEX_CHECKSUM_BASIS;
+    char *buffer=history_mmap(historyFile, 0, &historyStat, &newState);
+    bool indexable=buffer!=NULL;
+    unsigned threads=indexable?history_parallelism(historyStat.st_size):1;
+    if(threads>1) {
+        HistoryItems *history=history_rank_parallel(buffer, historyStat.st_size, threads,
+                &newState, format, ranking, blacklist);
+        bool ranked=newState.lineCount>0;
+        history_complete(history, &newState, &historyStat, fingerprint, ranked);
+        if(!ranked) {
+            // only history built here is freed - this may run in the loader while provisional history is shown
+            history_items_free(history);
+            free(history->corpus);
+            free(history->foldedCorpus);
+            free(history);
+            return NULL;
+        }
+        prioritizedHistory=history;
+        return prioritizedHistory;
+    }
+    if(indexable) {
+        history_lex_records(buffer, buffer+historyStat.st_size, newState.hasTimestamps, format,
+                &historyLines, &historyTimestamps, &historyLength, &newState.lastTimestamp);
+    } else {
+        history_readline_lines(format, &historyLines, &historyTimestamps, &historyLength);
+    }
+
+    if(historyLength > 0) {
+        // ranks are accumulated in one pass and sorted once when they are final
+        HistoryItems empty;
+        memset(&empty, 0, sizeof(empty));
+        newState.lineCount=0;
+        prioritizedHistory=history_rank_appended(
+                historyLines, historyTimestamps, historyLength,
+                &newState,
+                &empty,
+                ranking, blacklist);
+        free(historyLines);
+        free(historyTimestamps);
+        return history_complete(prioritizedHistory, &newState, &historyStat, fingerprint, indexable);
     } else {
+        free(historyLines);
+        free(historyTimestamps);
+        history_munmap();
         return NULL;
     }
 }
 
+/*
+ * Provisional history is ranked from a copy of the file tail so that it's independent
+ * of the history file mapping and statics used by the loader. It's ranked as if history
+ * started with the tail.
+ */
+static HistoryItems *history_rank_tail(const char *fileName, size_t size, int format,
+        int ranking, HashSet *blacklist)
+{
+    int fd=open(fileName, O_RDONLY);
+    if(fd<0) {
+        return NULL;
+    }
+    char head[2];
+    bool hasTimestamps=pread(fd, head, 2, 0)==2 && head[0]=='#' && isdigit((unsigned char)head[1]);
+    char *tail=malloc(HISTORY_PROGRESSIVE_TAIL_SIZE);
+    bool tailRead=pread(fd, tail, HISTORY_PROGRESSIVE_TAIL_SIZE, size-HISTORY_PROGRESSIVE_TAIL_SIZE)==HISTORY_PROGRESSIVE_TAIL_SIZE;
+    close(fd);
+    if(!tailRead) {
+        free(tail);
+        return NULL;
+    }
+
+    // tail starts in the middle of a record > the record is skipped
+    char *end=tail+HISTORY_PROGRESSIVE_TAIL_SIZE;
+    char *begin=history_lexer_record_end(tail, tail, end, format);
+    char **lines;
+    unsigned *timestamps, length, timestamp=0;
+    history_lex_records(begin, end, hasTimestamps, format, &lines, &timestamps, &length, &timestamp);
+    HistoryItems *history=NULL;
+    if(length) {
+        HistoryItems empty;
+        memset(&empty, 0, sizeof(empty));
+        HistoryIndexState state;
+        state.lineCount=0;
+        history=history_rank_appended(lines, timestamps, length, &state, &empty, ranking, blacklist);
+        history_pack_corpus(history);
+    }
+    free(lines);
+    free(timestamps);
+    free(tail);
+    return history;
+}
+
+static void history_free_provisional()
+{
+    history_items_free(provisionalHistory);
+    free(provisionalHistory->corpus);
+    free(provisionalHistory->foldedCorpus);
+    free(provisionalHistory);
+    provisionalHistory=NULL;
+}
+
+static void *history_load(void *arg)
+{
+    HistoryLoaderJob *job=arg;
+    get_prioritized_history(job->ranking, job->blacklist, job->memoryBudget);
+    pthread_mutex_lock(&historyLoaderMutex);
+    historyLoaderDone=true;
+    pthread_cond_signal(&historyLoaderCondition);
+    pthread_mutex_unlock(&historyLoaderMutex);
+    return NULL;
+}
+
+/*
+ * Big history is loaded by background thread. If it's not loaded within a short delay
+ * (warm start from index is), then provisional history of the file tail is returned and
+ * history_finish_loading() provides the complete history once it's loaded.
+ */
+HistoryItems *get_prioritized_history_progressively(int ranking, HashSet *blacklist, bool memoryBudget)
+{
+    char *historyFile=get_history_file_name();
+    struct stat historyStat;
+    if(stat(historyFile, &historyStat) || !S_ISREG(historyStat.st_mode)
+            || historyStat.st_size<=2*HISTORY_PROGRESSIVE_TAIL_SIZE) {
+        return get_prioritized_history(ranking, blacklist, memoryBudget);
+    }
+
+    historyLoaderJob.ranking=ranking;
+    historyLoaderJob.blacklist=blacklist;
+    historyLoaderJob.memoryBudget=memoryBudget;
+    if(pthread_create(&historyLoader, NULL, history_load, &historyLoaderJob)) {
+        return get_prioritized_history(ranking, blacklist, memoryBudget);
+    }
+    historyLoaderStarted=true;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec+=HISTORY_PROGRESSIVE_DELAY_MS*1000000L;
+    deadline.tv_sec+=deadline.tv_nsec/1000000000L;
+    deadline.tv_nsec%=1000000000L;
+    bool done;
+    int waitStatus=0;
+    pthread_mutex_lock(&historyLoaderMutex);
+    while(!historyLoaderDone && !waitStatus) {
+        waitStatus=pthread_cond_timedwait(&historyLoaderCondition, &historyLoaderMutex, &deadline);
+    }
+    done=historyLoaderDone;
+    pthread_mutex_unlock(&historyLoaderMutex);
+
+    if(!done) {
+        provisionalHistory=history_rank_tail(historyFile, historyStat.st_size, get_history_format(),
+                ranking, blacklist);
+        if(provisionalHistory) {
+            return provisionalHistory;
+        }
+    }
+    return history_finish_loading(true);
+}
+
+// provisional history is shown (complete history is being loaded or wasn't taken yet)
+bool history_is_loading()
+{
+    return historyLoaderStarted;
+}
+
+/*
+ * Complete history replaces provisional history once it's loaded - NULL is returned if
+ * it's not loaded yet and caller doesn't wait for it.
+ */
+HistoryItems *history_finish_loading(bool wait)
+{
+    if(!historyLoaderStarted) {
+        return NULL;
+    }
+    pthread_mutex_lock(&historyLoaderMutex);
+    bool done=historyLoaderDone;
+    pthread_mutex_unlock(&historyLoaderMutex);
+    if(!done && !wait) {
+        return NULL;
+    }
+    pthread_join(historyLoader, NULL);
+    historyLoaderStarted=false;
+
+    if(provisionalHistory) {
+        if(prioritizedHistory) {
+            history_free_provisional();
+        } else {
+            // history file was emptied meanwhile > stay with what was shown
+            prioritizedHistory=provisionalHistory;
+            historyCorpusPacked=true;
+            provisionalHistory=NULL;
+        }
+    }
+    return prioritizedHistory;
+}
+
 void free_prioritized_history()
 {
-    free(prioritizedHistory->items);
+    if(historyLoaderStarted && !history_finish_loading(false)) {
+        // HSTR is exiting > loader is abandoned w/o index being saved
+        history_free_provisional();
+        return;
+    }
+    // history was not idle long enough to save its index while shown
+    history_save_index();
+    history_items_free(prioritizedHistory);
+    if(historyCorpusPacked) {
+        free(prioritizedHistory->corpus);
+        free(prioritizedHistory->foldedCorpus);
+    }
+    if(prioritizedHistory->rawPages) {
+        history_pages_free(prioritizedHistory->rawPages);
+        free(prioritizedHistory->rawPages);
+    }
     free(prioritizedHistory);
+    history_index_close();
+    history_munmap();
 }
 
 void history_mgmt_open()
@@ -220,33 +1899,25 @@ void history_clear_dirty()
 
 int history_mgmt_remove_from_system_history(char *cmd)
 {
+    // items shown by HSTR are read from mapped file > readline history is needed for delete only
+    history_mgmt_load_system_history();
+
     int offset=history_search_pos(cmd, 0, 0), occurences=0;
     char *l;
     HISTORY_STATE *historyState=history_get_history_state();
 
-    // TODO refactor this code to have this in source exactly once
-    regex_t tsRegexp;
-    regex_t zshRegexp;
-    // HISTTIMEFORMAT defined > ^#1234567890$
-    const char *histtimeformatTimestamp = "^#[[:digit:]]\\{10,\\}$";
-    regexp_compile(&tsRegexp, histtimeformatTimestamp);
-
-    const char *zshTimestamp = "^: [[:digit:]]\\{10,\\}:[[:digit:]];.*";
-    regexp_compile(&zshRegexp, zshTimestamp);
-
+    unsigned timestamp;
     while(offset>=0) {
         l=historyState->entries[offset]->line;
         if(offset<historyState->length) {
-           if(!regexp_match(&zshRegexp, l)) {
-               l=l+15; //: 1485023566:0;whoami
-           }
+           l=history_lexer_zsh_command(l, &timestamp);
            if(!strcmp(cmd, l)) {
                occurences++;
                free_history_entry(remove_history(offset));
                if(offset>0) {
                    l=historyState->entries[offset-1]->line;
                    if(l && strlen(l)) {
-                       if(!regexp_match(&tsRegexp, l)) {
+                       if(history_lexer_bash_timestamp(l, &timestamp)) {
                            // TODO check that this delete doesn't cause mismatch of searched cmd to be deleted
                            free_history_entry(remove_history(offset-1));
                        }
@@ -259,16 +1930,36 @@ int history_mgmt_remove_from_system_history(char *cmd)
     if(occurences) {
         write_history(get_history_file_name());
         dirty=true;
+        if(prioritizedHistory && prioritizedHistory->rawPages) {
+            history_raw_reload(prioritizedHistory, get_history_file_name());
+        }
     }
     return occurences;
 }
 
 int history_mgmt_remove_from_raw(char *cmd, HistoryItems *history) {
+    // index of history w/o the command would not match history file
+    historyIndexItems=NULL;
+    if(history->rawPages) {
+        // paged raw history is reloaded once the command is deleted from history file
+        unsigned i;
+        int occurences=0;
+        for(i=0; i<history->rawCount; i++) {
+            if(!strcmp(cmd, history_raw_item(history, i))) {
+                occurences++;
+            }
+        }
+        history_raw_retain(history, NULL, 0);
+        return occurences;
+    }
     int occurences=history->rawCount;
     if(history->rawCount) {
         int i, ii;
         for(i=0, ii=0; i<history->rawCount; i++) {
             if(strcmp(cmd, history->rawItems[i])) {
+                history->rawLengths[ii]=history->rawLengths[i];
+                history->rawTimestamps[ii]=history->rawTimestamps[i];
+                history->rawIds[ii]=history->rawIds[i];
                 history->rawItems[ii++]=history->rawItems[i];
             }
         }
@@ -278,16 +1969,23 @@ int history_mgmt_remove_from_raw(char *cmd, HistoryItems *history) {
 }
 
 int history_mgmt_remove_from_ranked(char *cmd, HistoryItems *history) {
+    history_rank_items(history, history->count);
     int occurences=history->count;
     if(history->count) {
         int i, ii;
         for(i=0, ii=0; i<history->count; i++) {
             if(strcmp(cmd, history->items[i])) {
+                history->lengths[ii]=history->lengths[i];
+                history->hashes[ii]=history->hashes[i];
+                history->ranks[ii]=history->ranks[i];
                 history->items[ii++]=history->items[i];
             }
         }
         history->count=ii;
     }
+    history->rankedCount=history->count;
+    free(history->rankKeys);
+    history->rankKeys=NULL;
     return occurences-history->count;
 }
 
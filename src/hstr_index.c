@@ -0,0 +1,364 @@
+/*
+ hstr_index.c       persistent index of ranked history
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "include/hstr_index.h"
+#include "include/hstr_favorites.h"
+#include "include/hstr_utils.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+#define FNV64_OFFSET_BASIS 14695981039346656037ull
+#define FNV64_PRIME 1099511628211ull
+
+// index file mapped to memory - loaded history items point to its strings blob
+static char *indexBuffer;
+static size_t indexBufferSize;
+
+static uint32_t fnv_hash(uint32_t hash, const char *s)
+{
+    while(*s) {
+        hash^=(unsigned char)*s++;
+        hash*=FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t fnv64_hash(uint64_t hash, const char *buffer, size_t size)
+{
+    size_t i;
+    for(i=0; i<size; i++) {
+        hash^=(unsigned char)buffer[i];
+        hash*=FNV64_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * Checksum of indexed history prefix - whole prefix is hashed so that any rewrite of
+ * indexed history is detected. FNV step is applied to words rather than bytes to hash
+ * at memory speed (every step is a bijection of the state i.e. changed word changes it).
+ * Words are hashed from word aligned begin to the last whole word before end so that
+ * hashing can be continued from the same words hash when history is appended.
+ */
+uint64_t history_index_checksum_words(uint64_t words, const char *buffer, size_t begin, size_t end)
+{
+    uint64_t word;
+    size_t i;
+    for(i=begin-begin%sizeof(word); i+sizeof(word)<=end; i+=sizeof(word)) {
+        memcpy(&word, buffer+i, sizeof(word));
+        words=(words^word)*FNV64_PRIME;
+    }
+    return words;
+}
+
+// checksum of prefix of given size from hash of its whole words
+uint64_t history_index_checksum_finish(uint64_t words, const char *buffer, size_t size)
+{
+    size_t tail=size%sizeof(uint64_t);
+    words=fnv64_hash(words, buffer+size-tail, tail);
+    return fnv64_hash(words, (const char*)&size, sizeof(size));
+}
+
+// checksum of history file prefix - the file is mapped just to be hashed
+static bool history_index_file_checksum(const char *fileName, size_t size, uint64_t *checksum, uint64_t *words)
+{
+    if(!size) {
+        *words=HH_INDEX_CHECKSUM_BASIS;
+        *checksum=history_index_checksum_finish(*words, "", 0);
+        return true;
+    }
+    int fd=open(fileName, O_RDONLY);
+    if(fd<0) {
+        return false;
+    }
+    char *buffer=mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(buffer==MAP_FAILED) {
+        return false;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(buffer, size, MADV_SEQUENTIAL);
+#endif
+    *words=history_index_checksum_words(HH_INDEX_CHECKSUM_BASIS, buffer, 0, size);
+    *checksum=history_index_checksum_finish(*words, buffer, size);
+    munmap(buffer, size);
+    return true;
+}
+
+char* history_index_get_filename()
+{
+    char *home = getenv(ENV_VAR_HOME);
+    char *fileName = (char*) malloc(strlen(home) + 1 + strlen(FILE_HH_INDEX) + 1);
+    strcpy(fileName, home);
+    strcat(fileName, "/");
+    strcat(fileName, FILE_HH_INDEX);
+    return fileName;
+}
+
+// index is valid only for the configuration it was built with
+unsigned history_index_fingerprint(int format, int ranking, HashSet *blacklist)
+{
+    uint32_t result=FNV_OFFSET_BASIS;
+    result=(result^format)*FNV_PRIME;
+    result=(result^ranking)*FNV_PRIME;
+    if(blacklist) {
+        // keys order depends on insertion order > combine key hashes commutatively
+        uint32_t keysHash=0;
+        HashSetIterator it;
+        const char *key;
+        hashset_iterator_init(&it, blacklist);
+        while((key=hashset_iterator_next(&it, NULL, NULL))!=NULL) {
+            keysHash+=fnv_hash(FNV_OFFSET_BASIS, key);
+        }
+        result=(result^keysHash)*FNV_PRIME;
+    }
+    return result;
+}
+
+// items of corrupt index could point out of corpus
+static bool history_index_items_valid(uint64_t blobSize, const uint32_t *offsets, const uint32_t *lengths, unsigned count)
+{
+    unsigned i;
+    for(i=0; i<count; i++) {
+        if((uint64_t)offsets[i]+lengths[i]>=blobSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ids are dense - bitsets of ids (see SelectionDedup) are as big as the number of ids
+static bool history_index_ids_valid(const uint32_t *ids, unsigned count, uint64_t idCount)
+{
+    unsigned i;
+    for(i=0; i<count; i++) {
+        if(ids[i]>=idCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Loads index of history file. If history file didn't change, then HH_INDEX_CURRENT is
+ * returned. If history was only appended to indexed file, then HH_INDEX_PREFIX is returned
+ * and state can be used to continue indexing from where the previous indexation stopped.
+ * Corpus of loaded history is the mapped index file.
+ */
+int history_index_load(const char *historyFileName, const struct stat *historyStat, unsigned fingerprint,
+        HistoryIndexState *state, HistoryItems *history)
+{
+    char *fileName=history_index_get_filename();
+    int fd=open(fileName, O_RDONLY);
+    free(fileName);
+    if(fd<0) {
+        return HH_INDEX_INVALID;
+    }
+    struct stat indexStat;
+    if(fstat(fd, &indexStat) || indexStat.st_size<sizeof(HistoryIndexHeader)) {
+        close(fd);
+        return HH_INDEX_INVALID;
+    }
+    size_t size=indexStat.st_size;
+    char *buffer=mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(buffer==MAP_FAILED) {
+        return HH_INDEX_INVALID;
+    }
+
+    int result=HH_INDEX_INVALID;
+    // words hash of the indexed prefix is known only once it's validated
+    uint64_t words=0;
+    HistoryIndexHeader *header=(HistoryIndexHeader*)buffer;
+    if(!memcmp(header->magic, HH_INDEX_MAGIC, sizeof(header->magic))
+            && header->version==HH_INDEX_VERSION
+            && header->historyDevice==historyStat->st_dev
+            && header->historyInode==historyStat->st_ino
+            && header->fingerprint==fingerprint
+            && header->count
+            && size==sizeof(HistoryIndexHeader)
+                +(5*(uint64_t)header->count+4*(uint64_t)header->rawCount)*sizeof(uint32_t)
+                +2*header->blobSize
+            && !buffer[size-1-header->blobSize] && !buffer[size-1]) {
+        if(header->historySize==historyStat->st_size && header->historyMtime==historyStat->st_mtim.tv_sec
+                && header->historyMtimeNsec==historyStat->st_mtim.tv_nsec) {
+            result=HH_INDEX_CURRENT;
+        } else {
+            uint64_t checksum;
+            if(header->indexedSize<=historyStat->st_size
+                    && history_index_file_checksum(historyFileName, header->indexedSize, &checksum, &words)
+                    && checksum==header->indexedChecksum) {
+                result=HH_INDEX_PREFIX;
+            }
+        }
+    }
+
+    unsigned count=header->count, rawCount=header->rawCount;
+    uint32_t *offsets=(uint32_t*)(buffer+sizeof(HistoryIndexHeader));
+    uint32_t *lengths=offsets+count;
+    uint32_t *hashes=lengths+count;
+    uint32_t *ranks=hashes+count;
+    uint32_t *lastOccurrences=ranks+count;
+    uint32_t *rawOffsets=lastOccurrences+count;
+    uint32_t *rawLengths=rawOffsets+rawCount;
+    uint32_t *rawTimestamps=rawLengths+rawCount;
+    uint32_t *rawIds=rawTimestamps+rawCount;
+    char *blob=(char*)(rawIds+rawCount);
+    if(result!=HH_INDEX_INVALID
+            && (!history_index_items_valid(header->blobSize, offsets, lengths, count)
+                || !history_index_items_valid(header->blobSize, rawOffsets, rawLengths, rawCount)
+                || !history_index_ids_valid(rawIds, rawCount, count+rawCount))) {
+        result=HH_INDEX_INVALID;
+    }
+    if(result==HH_INDEX_INVALID) {
+        munmap(buffer, size);
+        return result;
+    }
+    unsigned i;
+    history->corpus=blob;
+    history->corpusSize=header->blobSize;
+    history->foldedCorpus=blob+header->blobSize;
+    history->count=count;
+    history->items=malloc(sizeof(char*) * count);
+    for(i=0; i<count; i++) {
+        history->items[i]=blob+offsets[i];
+    }
+    // arrays are copied as history items can be deleted
+    history->lengths=malloc(sizeof(unsigned) * count);
+    memcpy(history->lengths, lengths, sizeof(unsigned) * count);
+    history->hashes=malloc(sizeof(unsigned) * count);
+    memcpy(history->hashes, hashes, sizeof(unsigned) * count);
+    history->ranks=malloc(sizeof(unsigned) * count);
+    memcpy(history->ranks, ranks, sizeof(unsigned) * count);
+    history->rankedCount=count;
+    history->rankKeys=NULL;
+    history->rawCount=rawCount;
+    history->rawItems=malloc(sizeof(char*) * (rawCount?rawCount:1));
+    for(i=0; i<rawCount; i++) {
+        history->rawItems[i]=blob+rawOffsets[i];
+    }
+    history->rawLengths=malloc(sizeof(unsigned) * (rawCount?rawCount:1));
+    memcpy(history->rawLengths, rawLengths, sizeof(unsigned) * rawCount);
+    history->rawTimestamps=malloc(sizeof(unsigned) * (rawCount?rawCount:1));
+    memcpy(history->rawTimestamps, rawTimestamps, sizeof(unsigned) * rawCount);
+    history->rawIds=malloc(sizeof(unsigned) * (rawCount?rawCount:1));
+    memcpy(history->rawIds, rawIds, sizeof(unsigned) * rawCount);
+    history->rawPages=NULL;
+
+    state->indexedSize=header->indexedSize;
+    state->indexedChecksum=header->indexedChecksum;
+    state->indexedWords=words;
+    state->lineCount=header->lineCount;
+    state->hasTimestamps=header->hasTimestamps;
+    state->lastTimestamp=header->lastTimestamp;
+    state->ranks=ranks;
+    state->lastOccurrences=lastOccurrences;
+
+    indexBuffer=buffer;
+    indexBufferSize=size;
+    return result;
+}
+
+// corpus offsets of history items
+static uint32_t *history_index_offsets(HistoryItems *history, char **items, unsigned count)
+{
+    uint32_t *offsets=malloc(sizeof(uint32_t) * (count?count:1));
+    unsigned i;
+    for(i=0; i<count; i++) {
+        offsets[i]=items[i]-history->corpus;
+    }
+    return offsets;
+}
+
+void history_index_save(const struct stat *historyStat, unsigned fingerprint, HistoryIndexState *state,
+        HistoryItems *history)
+{
+    // offsets are 32b > history too big to be indexed
+    if(history->corpusSize>=UINT32_MAX) {
+        return;
+    }
+
+    HistoryIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HH_INDEX_MAGIC, sizeof(header.magic));
+    header.version=HH_INDEX_VERSION;
+    header.historyDevice=historyStat->st_dev;
+    header.historyInode=historyStat->st_ino;
+    header.historySize=historyStat->st_size;
+    header.historyMtime=historyStat->st_mtim.tv_sec;
+    header.historyMtimeNsec=historyStat->st_mtim.tv_nsec;
+    header.indexedSize=state->indexedSize;
+    header.indexedChecksum=state->indexedChecksum;
+    header.fingerprint=fingerprint;
+    header.lineCount=state->lineCount;
+    header.hasTimestamps=state->hasTimestamps;
+    header.count=history->count;
+    header.rawCount=history->rawCount;
+    header.lastTimestamp=state->lastTimestamp;
+    header.blobSize=history->corpusSize;
+
+    unsigned count=history->count, rawCount=history->rawCount;
+    uint32_t *offsets=history_index_offsets(history, history->items, count);
+    uint32_t *rawOffsets=history_index_offsets(history, history->rawItems, rawCount);
+
+    // write to temporary file and rename it so that concurrent HSTRs never see partial index
+    char *fileName=history_index_get_filename();
+    char *tmpFileName=malloc(strlen(fileName)+32);
+    sprintf(tmpFileName, "%s.%d", fileName, (int)getpid());
+    FILE *file=fopen(tmpFileName, "wb");
+    if(file) {
+        bool written=fwrite(&header, sizeof(header), 1, file)==1
+            && fwrite(offsets, sizeof(uint32_t), count, file)==count
+            && fwrite(history->lengths, sizeof(uint32_t), count, file)==count
+            && fwrite(history->hashes, sizeof(uint32_t), count, file)==count
+            && fwrite(state->ranks, sizeof(uint32_t), count, file)==count
+            && fwrite(state->lastOccurrences, sizeof(uint32_t), count, file)==count
+            && fwrite(rawOffsets, sizeof(uint32_t), rawCount, file)==rawCount
+            && fwrite(history->rawLengths, sizeof(uint32_t), rawCount, file)==rawCount
+            && fwrite(history->rawTimestamps, sizeof(uint32_t), rawCount, file)==rawCount
+            && fwrite(history->rawIds, sizeof(uint32_t), rawCount, file)==rawCount
+            && fwrite(history->corpus, 1, history->corpusSize, file)==history->corpusSize
+            && fwrite(history->foldedCorpus, 1, history->corpusSize, file)==history->corpusSize;
+        if(!fclose(file) && written) {
+            rename(tmpFileName, fileName);
+        } else {
+            unlink(tmpFileName);
+        }
+    }
+    free(tmpFileName);
+    free(fileName);
+    free(offsets);
+    free(rawOffsets);
+}
+
+void history_index_close()
+{
+    if(indexBuffer) {
+        munmap(indexBuffer, indexBufferSize);
+        indexBuffer=NULL;
+    }
+}
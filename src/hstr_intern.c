@@ -0,0 +1,79 @@
+/*
+ hstr_intern.c      string interning
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "include/hstr_intern.h"
+
+#define INTERN_INITIAL_CAPACITY 1024
+
+void intern_init(InternTable *table, int subsystem)
+{
+    hashset_init_borrowed(&table->ids, subsystem);
+    table->capacity=INTERN_INITIAL_CAPACITY;
+    table->strings=malloc(sizeof(char*) * table->capacity);
+    table->lengths=malloc(sizeof(unsigned) * table->capacity);
+    table->hashes=malloc(sizeof(unsigned) * table->capacity);
+    table->count=0;
+}
+
+// id of the string - string which was not interned yet gets a new id
+unsigned intern_id(InternTable *table, const char *string, unsigned length)
+{
+    return intern_id_hashed(table, string, length, hashmap_hash(string, length));
+}
+
+unsigned intern_id_hashed(InternTable *table, const char *string, unsigned length, unsigned hash)
+{
+    void *id=hashset_get_hashed(&table->ids, string, length, hash);
+    if(id) {
+        return (uintptr_t)id-1;
+    }
+    if(table->count==table->capacity) {
+        table->capacity*=2;
+        table->strings=realloc(table->strings, sizeof(char*) * table->capacity);
+        table->lengths=realloc(table->lengths, sizeof(unsigned) * table->capacity);
+        table->hashes=realloc(table->hashes, sizeof(unsigned) * table->capacity);
+    }
+    table->strings[table->count]=string;
+    table->lengths[table->count]=length;
+    table->hashes[table->count]=hash;
+    hashset_put_hashed(&table->ids, string, length, hash, (void*)(uintptr_t)(table->count+1));
+    return table->count++;
+}
+
+// id of the string or INTERN_ID_NONE if it's not interned
+unsigned intern_lookup(const InternTable *table, const char *string, unsigned length)
+{
+    return intern_lookup_hashed(table, string, length, hashmap_hash(string, length));
+}
+
+unsigned intern_lookup_hashed(const InternTable *table, const char *string, unsigned length, unsigned hash)
+{
+    void *id=hashset_get_hashed(&table->ids, string, length, hash);
+    return id?(unsigned)((uintptr_t)id-1):INTERN_ID_NONE;
+}
+
+void intern_destroy(InternTable *table)
+{
+    hashset_destroy(&table->ids, false);
+    free(table->strings);
+    free(table->lengths);
+    free(table->hashes);
+}
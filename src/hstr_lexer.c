@@ -0,0 +1,190 @@
+/*
+ hstr_lexer.c       lexer of BASH and zsh history files
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hstr_lexer.h"
+
+void history_lexer_init(HistoryLexer *lexer, char *begin, char *end, int format, bool hasTimestamps, unsigned timestamp)
+{
+    lexer->p=begin;
+    lexer->end=end;
+    lexer->format=format;
+    lexer->hasTimestamps=hasTimestamps;
+    lexer->timestamp=timestamp;
+}
+
+// #1234567890 line written by BASH when HISTTIMEFORMAT is set
+bool history_lexer_bash_timestamp(const char *line, unsigned *timestamp)
+{
+    if(line[0]=='#') {
+        const char *p=line+1;
+        unsigned long value=0;
+        while(isdigit((unsigned char)*p)) {
+            value=value*10+(*p++-'0');
+        }
+        if(p-line>10 && !*p) {
+            *timestamp=value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// zsh extended history header ": <beginning time>:<elapsed seconds>;<command>" is skipped
+char *history_lexer_zsh_command(char *line, unsigned *timestamp)
+{
+    if(line[0]==':' && line[1]==' ' && isdigit((unsigned char)line[2])) {
+        char *p=line+2;
+        unsigned long value=0;
+        while(isdigit((unsigned char)*p)) {
+            value=value*10+(*p++-'0');
+        }
+        if(*p==':') {
+            p++;
+            while(isdigit((unsigned char)*p)) {
+                p++;
+            }
+            if(*p==';') {
+                *timestamp=value;
+                return p+1;
+            }
+        }
+    }
+    return line;
+}
+
+// unmetafied command is written in place and its new length is returned
+size_t history_lexer_unmetafy(char *command, size_t length)
+{
+    char *r=memchr(command, ZSH_META, length);
+    if(!r) {
+        return length;
+    }
+    char *w=r, *end=command+length;
+    while(r<end) {
+        if((unsigned char)*r==ZSH_META && r+1<end) {
+            *w++=r[1]^32;
+            r+=2;
+        } else {
+            *w++=*r++;
+        }
+    }
+    *w=0;
+    return w-command;
+}
+
+// zsh escapes EOL in multi-line command with backslash (unless the backslash is escaped)
+static bool history_lexer_continued(const char *begin, const char *eol)
+{
+    return eol>begin && eol[-1]=='\\' && !(eol-1>begin && eol[-2]=='\\');
+}
+
+// end of the record which contains p i.e. the first byte after its EOL
+char *history_lexer_record_end(char *begin, char *p, char *end, int format)
+{
+    while(p<end && (p=memchr(p, '\n', end-p))!=NULL) {
+        if(format!=HISTORY_FORMAT_ZSH || !history_lexer_continued(begin, p)) {
+            return p+1;
+        }
+        p++;
+    }
+    return end;
+}
+
+/*
+ * Lines of zsh record continued by escaped EOLs are joined in place to one multi-line
+ * command. End of the joined command is returned (NULL if the record is unterminated)
+ * and next points to the record which follows.
+ */
+static char *history_lexer_join(char *line, char *eol, char *end, char **next)
+{
+    char *w=eol, *r=eol+1, *nextEol;
+    size_t length;
+    while(true) {
+        w[-1]='\n';
+        if((nextEol=memchr(r, '\n', end-r))==NULL) {
+            return NULL;
+        }
+        length=nextEol-r;
+        memmove(w, r, length);
+        w+=length;
+        r=nextEol+1;
+        if(!history_lexer_continued(line, w)) {
+            *next=r;
+            return w;
+        }
+    }
+}
+
+/*
+ * Next record is lexed in place: EOL is replaced with NUL and zsh header and metafication
+ * are removed. Records follow read_history() semantics: trailing CR is dropped, empty
+ * lines are skipped, unterminated last line is ignored and if the file starts with a
+ * timestamp, then #<digit> lines are timestamps rather than entries. Otherwise #1234567890
+ * lines are entries of readline history, but not commands.
+ */
+bool history_lexer_next(HistoryLexer *lexer, HistoryRecord *record)
+{
+    char *p=lexer->p, *eol, *line;
+    // memchr() is vectorized in libc > fast scan for EOLs
+    while(p<lexer->end && (eol=memchr(p, '\n', lexer->end-p))!=NULL) {
+        line=p;
+        if(lexer->format==HISTORY_FORMAT_ZSH && history_lexer_continued(line, eol)) {
+            if((eol=history_lexer_join(line, eol, lexer->end, &p))==NULL) {
+                break;
+            }
+        } else {
+            p=eol+1;
+        }
+        *eol=0;
+        if(eol>line && eol[-1]=='\r') {
+            *--eol=0;
+        }
+
+        if(line[0]=='#' && isdigit((unsigned char)line[1])) {
+            if(lexer->hasTimestamps) {
+                lexer->timestamp=strtoul(line+1, NULL, 10);
+                continue;
+            }
+            if(history_lexer_bash_timestamp(line, &lexer->timestamp)) {
+                record->command=NULL;
+                record->timestamp=lexer->timestamp;
+                lexer->p=p;
+                return true;
+            }
+        }
+        if(lexer->format==HISTORY_FORMAT_ZSH) {
+            char *command=history_lexer_zsh_command(line, &lexer->timestamp);
+            history_lexer_unmetafy(command, eol-command);
+            line=command;
+        }
+        if(*line) {
+            record->command=line;
+            record->timestamp=lexer->timestamp;
+            lexer->p=p;
+            return true;
+        }
+    }
+    lexer->p=lexer->end;
+    return false;
+}
@@ -0,0 +1,267 @@
+/*
+ hstr_matcher.c     substring matcher of history items
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hstr_matcher.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATCHER_X86
+#include <immintrin.h>
+#define MATCHER_NO_SANITIZE __attribute__((no_sanitize_address))
+#endif
+
+#define MATCHER_PAGE_SIZE 4096
+
+typedef int (*MatcherKernel)(const Matcher *matcher, const char *haystack, unsigned length);
+
+static MatcherKernel matcherKernel;
+static const char *matcherKernelName;
+
+// bytes of commands from the most common ones - other bytes are considered rare
+static const char matcherCommonBytes[]=" etsaorinl-/cdpmhug.ybfk=wvx0123456789_\"'|jqz$>:*ACDEFGHIJKLMNOPQRSTUVWXYZB";
+static unsigned char matcherFrequency[256];
+
+// needle matches at p
+static inline bool matcher_verify(const Matcher *matcher, const char *p)
+{
+    unsigned i;
+    for(i=0; i<matcher->length; i++) {
+        if(p[i]!=matcher->needle[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// positions from start on are scanned for the rarest needle byte - also tail of vector kernels
+static int matcher_find_scalar_from(const Matcher *matcher, const char *haystack, unsigned length, unsigned start)
+{
+    unsigned offset=matcher->filterOffsets[0];
+    char filter=matcher->needle[offset];
+    // memchr() vectorized in libc skips to candidates
+    const char *p=haystack+start+offset, *end=haystack+length-matcher->length+1+offset;
+    while(p<end && (p=memchr(p, filter, end-p))!=NULL) {
+        if(matcher_verify(matcher, p-offset)) {
+            return p-offset-haystack;
+        }
+        p++;
+    }
+    return MATCHER_NONE;
+}
+
+static int matcher_find_scalar(const Matcher *matcher, const char *haystack, unsigned length)
+{
+    return matcher_find_scalar_from(matcher, haystack, length, 0);
+}
+
+// candidate positions of mask from position i on are verified
+static inline int matcher_verify_mask(const Matcher *matcher, const char *haystack, unsigned i, unsigned mask)
+{
+    unsigned bit;
+    while(mask) {
+        bit=__builtin_ctz(mask);
+        if(matcher_verify(matcher, haystack+i+bit)) {
+            return i+bit;
+        }
+        mask&=mask-1;
+    }
+    return MATCHER_NONE;
+}
+
+/*
+ * Vector kernels compare a block of candidate positions shifted by offsets of the two
+ * rarest needle bytes w/ these bytes at once. Only positions where both bytes match are
+ * verified. Block which would cross haystack end is moved back to overlap the previous
+ * one, whose positions are masked out, therefore there is no scalar tail.
+ */
+#ifdef MATCHER_X86
+__attribute__((target("sse2"))) MATCHER_NO_SANITIZE
+static inline unsigned matcher_mask_sse2(const Matcher *matcher, const char *p, __m128i filter0, __m128i filter1)
+{
+    __m128i block0=_mm_loadu_si128((const __m128i*)(p+matcher->filterOffsets[0]));
+    __m128i block1=_mm_loadu_si128((const __m128i*)(p+matcher->filterOffsets[1]));
+    return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block0, filter0), _mm_cmpeq_epi8(block1, filter1)));
+}
+
+// block may be read past haystack end if it doesn't cross (the smallest) page
+#define MATCHER_IN_PAGE(P, SIZE) (((uintptr_t)(P)&(MATCHER_PAGE_SIZE-1))<=MATCHER_PAGE_SIZE-(SIZE))
+
+/*
+ * Haystack shorter than a block is searched by one block whose positions past the last
+ * candidate are masked out - bytes past haystack end are read, but not matched.
+ */
+__attribute__((target("sse2"))) MATCHER_NO_SANITIZE
+static int matcher_find_short_sse2(const Matcher *matcher, const char *haystack, unsigned length, unsigned end)
+{
+    if(!MATCHER_IN_PAGE(haystack+matcher->filterOffsets[0], 16) || !MATCHER_IN_PAGE(haystack+matcher->filterOffsets[1], 16)) {
+        return matcher_find_scalar_from(matcher, haystack, length, 0);
+    }
+    const __m128i filter0=_mm_loadu_si128((const __m128i*)matcher->filters[0]);
+    const __m128i filter1=_mm_loadu_si128((const __m128i*)matcher->filters[1]);
+    return matcher_verify_mask(matcher, haystack, 0,
+            matcher_mask_sse2(matcher, haystack, filter0, filter1)&((1u<<end)-1));
+}
+
+__attribute__((target("sse2")))
+static int matcher_find_sse2(const Matcher *matcher, const char *haystack, unsigned length)
+{
+    // count of candidate positions
+    unsigned end=length-matcher->length+1, i;
+    int result;
+    if(end<16) {
+        return matcher_find_short_sse2(matcher, haystack, length, end);
+    }
+    const __m128i filter0=_mm_loadu_si128((const __m128i*)matcher->filters[0]);
+    const __m128i filter1=_mm_loadu_si128((const __m128i*)matcher->filters[1]);
+    for(i=0; i+16<=end; i+=16) {
+        if((result=matcher_verify_mask(matcher, haystack, i, matcher_mask_sse2(matcher, haystack+i, filter0, filter1)))!=MATCHER_NONE) {
+            return result;
+        }
+    }
+    if(i<end) {
+        return matcher_verify_mask(matcher, haystack, i,
+                matcher_mask_sse2(matcher, haystack+end-16, filter0, filter1)>>(i-(end-16)));
+    }
+    return MATCHER_NONE;
+}
+
+__attribute__((target("avx2"))) MATCHER_NO_SANITIZE
+static inline unsigned matcher_mask_avx2(const Matcher *matcher, const char *p, __m256i filter0, __m256i filter1)
+{
+    __m256i block0=_mm256_loadu_si256((const __m256i*)(p+matcher->filterOffsets[0]));
+    __m256i block1=_mm256_loadu_si256((const __m256i*)(p+matcher->filterOffsets[1]));
+    return _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block0, filter0), _mm256_cmpeq_epi8(block1, filter1)));
+}
+
+__attribute__((target("avx2"))) MATCHER_NO_SANITIZE
+static int matcher_find_short_avx2(const Matcher *matcher, const char *haystack, unsigned length, unsigned end)
+{
+    if(!MATCHER_IN_PAGE(haystack+matcher->filterOffsets[0], 32) || !MATCHER_IN_PAGE(haystack+matcher->filterOffsets[1], 32)) {
+        return matcher_find_sse2(matcher, haystack, length);
+    }
+    const __m256i filter0=_mm256_loadu_si256((const __m256i*)matcher->filters[0]);
+    const __m256i filter1=_mm256_loadu_si256((const __m256i*)matcher->filters[1]);
+    return matcher_verify_mask(matcher, haystack, 0,
+            matcher_mask_avx2(matcher, haystack, filter0, filter1)&((1u<<end)-1));
+}
+
+__attribute__((target("avx2")))
+static int matcher_find_avx2(const Matcher *matcher, const char *haystack, unsigned length)
+{
+    unsigned end=length-matcher->length+1, i;
+    int result;
+    if(end<32) {
+        return matcher_find_short_avx2(matcher, haystack, length, end);
+    }
+    const __m256i filter0=_mm256_loadu_si256((const __m256i*)matcher->filters[0]);
+    const __m256i filter1=_mm256_loadu_si256((const __m256i*)matcher->filters[1]);
+    for(i=0; i+32<=end; i+=32) {
+        if((result=matcher_verify_mask(matcher, haystack, i, matcher_mask_avx2(matcher, haystack+i, filter0, filter1)))!=MATCHER_NONE) {
+            return result;
+        }
+    }
+    if(i<end) {
+        return matcher_verify_mask(matcher, haystack, i,
+                matcher_mask_avx2(matcher, haystack+end-32, filter0, filter1)>>(i-(end-32)));
+    }
+    return MATCHER_NONE;
+}
+#endif
+
+// the best kernel supported by CPU is chosen once
+static void matcher_select_kernel()
+{
+    unsigned i;
+    memset(matcherFrequency, 0, sizeof(matcherFrequency));
+    for(i=0; i<sizeof(matcherCommonBytes)-1; i++) {
+        matcherFrequency[(unsigned char)matcherCommonBytes[i]]=sizeof(matcherCommonBytes)-1-i;
+    }
+
+    matcherKernel=matcher_find_scalar;
+    matcherKernelName="scalar";
+#ifdef MATCHER_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        matcherKernel=matcher_find_avx2;
+        matcherKernelName="avx2";
+    } else if(__builtin_cpu_supports("sse2")) {
+        matcherKernel=matcher_find_sse2;
+        matcherKernelName="sse2";
+    }
+#endif
+}
+
+const char *matcher_kernel_name()
+{
+    if(!matcherKernel) {
+        matcher_select_kernel();
+    }
+    return matcherKernelName;
+}
+
+void matcher_init(Matcher *matcher, const char *needle, unsigned length)
+{
+    if(!matcherKernel) {
+        matcher_select_kernel();
+    }
+    matcher->length=length;
+    matcher->needle=malloc(length+1);
+    memcpy(matcher->needle, needle, length);
+    matcher->needle[length]=0;
+
+    // filter bytes are the rarest and the second rarest one (at other offset)
+    unsigned i, rarest=0, second=length>1?1:0;
+    for(i=0; i<length; i++) {
+        if(matcherFrequency[(unsigned char)needle[i]]<matcherFrequency[(unsigned char)needle[rarest]]) {
+            rarest=i;
+        }
+    }
+    for(i=0; i<length; i++) {
+        if(i!=rarest && (second==rarest
+                || matcherFrequency[(unsigned char)needle[i]]<matcherFrequency[(unsigned char)needle[second]])) {
+            second=i;
+        }
+    }
+    matcher->filterOffsets[0]=rarest<second?rarest:second;
+    matcher->filterOffsets[1]=rarest<second?second:rarest;
+    for(i=0; i<2; i++) {
+        memset(matcher->filters[i], length?needle[matcher->filterOffsets[i]]:0, sizeof(matcher->filters[i]));
+    }
+}
+
+// offset of the first occurrence of needle in haystack of given byte length or MATCHER_NONE
+int matcher_find(const Matcher *matcher, const char *haystack, unsigned length)
+{
+    if(!matcher->length) {
+        return 0;
+    }
+    if(matcher->length>length) {
+        return MATCHER_NONE;
+    }
+    return matcherKernel(matcher, haystack, length);
+}
+
+void matcher_destroy(Matcher *matcher)
+{
+    free(matcher->needle);
+    matcher->needle=NULL;
+}
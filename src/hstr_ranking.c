@@ -0,0 +1,80 @@
+/*
+ hstr_ranking.c     ranking of history items
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <math.h>
+
+#include "include/hstr_ranking.h"
+#include "include/hstr_utils.h"
+
+// the least orders with floor(10*ln(order)) equal to index (sentinel terminated)
+const uint64_t rankingLogThresholds[RANKING_LOG_VALUES+1]={
+    1, 2, 2, 2, 2, 2, 2, 3,
+    3, 3, 3, 4, 4, 4, 5, 5,
+    5, 6, 7, 7, 8, 9, 10, 10,
+    12, 13, 14, 15, 17, 19, 21, 23,
+    25, 28, 30, 34, 37, 41, 45, 50,
+    55, 61, 67, 74, 82, 91, 100, 110,
+    122, 135, 149, 165, 182, 201, 222, 245,
+    271, 299, 331, 366, 404, 446, 493, 545,
+    602, 666, 736, 813, 898, 993, 1097, 1212,
+    1340, 1481, 1636, 1809, 1999, 2209, 2441, 2698,
+    2981, 3295, 3641, 4024, 4448, 4915, 5432, 6003,
+    6635, 7332, 8104, 8956, 9898, 10939, 12089, 13360,
+    14765, 16318, 18034, 19931, 22027, 24344, 26904, 29733,
+    32860, 36316, 40135, 44356, 49021, 54177, 59875, 66172,
+    73131, 80822, 89322, 98716, 109098, 120572, 133253, 147267,
+    162755, 179872, 198790, 219696, 242802, 268338, 296559, 327748,
+    362218, 400313, 442414, 488943, 540365, 597196, 660004, 729417,
+    806130, 890912, 984610, 1088162, 1202605, 1329084, 1468865, 1623346,
+    1794075, 1982760, 2191288, 2421748, 2676446, 2957930, 3269018, 3612823,
+    3992787, 4412712, 4876801, 5389699, 5956539, 6582993, 7275332, 8040486,
+    8886111, 9820671, 10853520, 11994995, 13256520, 14650720, 16191550, 17894430,
+    19776403, 21856306, 24154953, 26695352, 29502926, 32605776, 36034956, 39824785,
+    44013194, 48642102, 53757836, 59411597, 65659970, 72565489, 80197268, 88631688,
+    97953164, 108254988, 119640265, 132222941, 146128949, 161497465, 178482301, 197253449,
+    217998775, 240925906, 266264305, 294267567, 325215957, 359419217, 397219666, 438995623,
+    485165196, 536190465, 592582108, 654904513, 723781421, 799902178, 884028624, 977002726,
+    1079755000, 1193313825, 1318815735, 1457516797, 1610805176, 1780215035, 1967441885, 2174359554,
+    2403038945, 2655768756, 2935078395, 3243763284, 3584912847, 3961941422, 1ull<<32
+};
+
+// floor(10*ln(2^i))
+const unsigned char rankingLogOfPowers[32]={
+    0, 6, 13, 20, 27, 34, 41, 48, 55, 62, 69, 76, 83, 90, 97, 103,
+    110, 117, 124, 131, 138, 145, 152, 159, 166, 173, 180, 187, 194, 201, 207, 214
+};
+
+/*
+ * Time-decay rank is an effective timestamp: halfLife*log2(sum(2^(t/halfLife))) over
+ * occurrence timestamps t. Comparing such ranks is the same as comparing sums of
+ * occurrence weights decaying with age, but unlike weights the rank doesn't change
+ * with time and can be cached. It is folded in one pass as log-sum-exp of
+ * the rank and the new occurrence timestamp.
+ */
+unsigned ranking_time_decay(unsigned rank, unsigned timestamp)
+{
+    if(!rank) {
+        return timestamp;
+    }
+    unsigned newer=MAX(rank, timestamp), older=MIN(rank, timestamp);
+    if(newer-older>=HISTORY_TIME_DECAY_HORIZON) {
+        return newer;
+    }
+    double metrics=newer+HISTORY_TIME_DECAY_HALF_LIFE*log2(1.0+exp2(((double)older-newer)/HISTORY_TIME_DECAY_HALF_LIFE));
+    return metrics<UINT_MAX?(unsigned)(metrics+0.5):UINT_MAX;
+}
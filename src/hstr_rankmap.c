@@ -0,0 +1,138 @@
+/*
+ hstr_rankmap.c     concurrent rank map
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "include/hstr_rankmap.h"
+#include "include/hstr_utils.h"
+
+HASHMAP_DEFINE(RankShardMap, rankshard)
+HASHMAP_DEFINE(FrozenRankIndex, frozen_index)
+
+typedef struct {
+    const char *item;
+    unsigned length;
+    unsigned hash;
+    RankAccumulator accumulator;
+} FrozenRankItem;
+
+// map is allocated aligned as malloc() doesn't honor alignment of shards - release it with free()
+ConcurrentRankMap *concurrent_rankmap_new(int subsystem)
+{
+    void *memory;
+    if(posix_memalign(&memory, __alignof__(RankShard), sizeof(ConcurrentRankMap))) {
+        return NULL;
+    }
+    ConcurrentRankMap *map=memory;
+    unsigned i;
+    for(i=0; i<RANKMAP_SHARDS; i++) {
+        pthread_mutex_init(&map->shards[i].lock, NULL);
+        rankshard_init(&map->shards[i].map, subsystem, true);
+    }
+    return map;
+}
+
+// contribution of occurrence is added to rank (saturated) and the latest occurrence is kept
+void concurrent_rankmap_add(ConcurrentRankMap *map, const char *key, unsigned length, unsigned hash,
+        unsigned contribution, unsigned order)
+{
+    bool added;
+    RankShard *shard=&map->shards[hash>>(32-RANKMAP_SHARD_BITS)];
+    pthread_mutex_lock(&shard->lock);
+    RankAccumulator *accumulator=&rankshard_put_hashed(&shard->map, key, length, hash, &added)->value;
+    accumulator->rank=contribution<UINT_MAX-accumulator->rank?accumulator->rank+contribution:UINT_MAX;
+    if(added || order>accumulator->lastOccurrence) {
+        accumulator->lastOccurrence=order;
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+static int frozen_rankmap_compare(const void *a, const void *b)
+{
+    const FrozenRankItem *aa=a, *bb=b;
+    if(aa->accumulator.lastOccurrence!=bb->accumulator.lastOccurrence) {
+        return aa->accumulator.lastOccurrence>bb->accumulator.lastOccurrence?-1:1;
+    }
+    int result=memcmp(aa->item, bb->item, MIN(aa->length, bb->length));
+    return result?result:(aa->length>bb->length)-(aa->length<bb->length);
+}
+
+/*
+ * Map is frozen once all threads are done with it: items of shards are sorted to
+ * canonical order and indexed. Concurrent map is destroyed.
+ */
+void concurrent_rankmap_freeze(ConcurrentRankMap *map, FrozenRankMap *frozen)
+{
+    unsigned i, count=0, position;
+    RankShardMapSlot *slot;
+    for(i=0; i<RANKMAP_SHARDS; i++) {
+        count+=map->shards[i].map.currentSize;
+    }
+    FrozenRankItem *items=malloc(sizeof(FrozenRankItem) * (count?count:1));
+    count=0;
+    for(i=0; i<RANKMAP_SHARDS; i++) {
+        position=0;
+        while((slot=rankshard_next(&map->shards[i].map, &position))!=NULL) {
+            items[count].item=slot->key;
+            items[count].length=slot->length;
+            items[count].hash=slot->hash;
+            items[count++].accumulator=slot->value;
+        }
+        rankshard_destroy(&map->shards[i].map);
+        pthread_mutex_destroy(&map->shards[i].lock);
+    }
+    qsort(items, count, sizeof(FrozenRankItem), frozen_rankmap_compare);
+
+    bool added;
+    frozen->count=count;
+    frozen->items=malloc(sizeof(char*) * (count?count:1));
+    frozen->lengths=malloc(sizeof(unsigned) * (count?count:1));
+    frozen->hashes=malloc(sizeof(unsigned) * (count?count:1));
+    frozen->ranks=malloc(sizeof(unsigned) * (count?count:1));
+    frozen->lastOccurrences=malloc(sizeof(unsigned) * (count?count:1));
+    frozen_index_init(&frozen->index, map->shards[0].map.arena.subsystem, true);
+    for(i=0; i<count; i++) {
+        frozen->items[i]=items[i].item;
+        frozen->lengths[i]=items[i].length;
+        frozen->hashes[i]=items[i].hash;
+        frozen->ranks[i]=items[i].accumulator.rank;
+        frozen->lastOccurrences[i]=items[i].accumulator.lastOccurrence;
+        frozen_index_put_hashed(&frozen->index, items[i].item, items[i].length, items[i].hash, &added)->value=i;
+    }
+    free(items);
+}
+
+// index of the item or RANKMAP_NONE
+unsigned frozen_rankmap_find(const FrozenRankMap *frozen, const char *key, unsigned length)
+{
+    FrozenRankIndexSlot *slot=frozen_index_get(&frozen->index, key, length);
+    return slot?slot->value:RANKMAP_NONE;
+}
+
+void frozen_rankmap_destroy(FrozenRankMap *frozen)
+{
+    free(frozen->items);
+    free(frozen->lengths);
+    free(frozen->hashes);
+    free(frozen->ranks);
+    free(frozen->lastOccurrences);
+    frozen_index_destroy(&frozen->index);
+}
@@ -22,9 +22,13 @@
 
 #define REGEXP_MATCH_BUFFER_SIZE 1
 
+HASHMAP_DEFINE(RegexpCache, regexp_cache)
+
 void hstr_regexp_init(HstrRegexp *hstrRegexp)
 {
-    hashset_init(&hstrRegexp->cache);
+    hstrRegexp->caseSensitive=false;
+    regexp_cache_init(&hstrRegexp->cache[false], ARENA_HASHSET, false);
+    regexp_cache_init(&hstrRegexp->cache[true], ARENA_HASHSET, false);
 }
 
 bool hstr_regexp_match(
@@ -35,21 +39,22 @@ bool hstr_regexp_match(
         char *errorMessage,
         const size_t errorMessageSize)
 {
-    regex_t* compiled;
-    if(hashset_contains(&hstrRegexp->cache,regexp)) {
-        compiled=hashset_get(&hstrRegexp->cache, regexp);
-    } else {
-        compiled=malloc(sizeof(regex_t));
+    bool added;
+    unsigned length=strlen(regexp);
+    RegexpCache *cache=&hstrRegexp->cache[hstrRegexp->caseSensitive];
+    RegexpCacheSlot *slot=regexp_cache_put(cache, regexp, length, &added);
+    if(added) {
+        slot->value=malloc(sizeof(regex_t));
         int compilationFlags=(hstrRegexp->caseSensitive?0:REG_ICASE);
-        int compilationStatus=regcomp(compiled, regexp, compilationFlags);
-        if(!compilationStatus) {
-            hashset_put(&hstrRegexp->cache, hstr_strdup(regexp), compiled);
-        } else {
-            regerror(compilationStatus, compiled, errorMessage, errorMessageSize);
-            free(compiled);
+        int compilationStatus=regcomp(slot->value, regexp, compilationFlags);
+        if(compilationStatus) {
+            regerror(compilationStatus, slot->value, errorMessage, errorMessageSize);
+            free(slot->value);
+            regexp_cache_remove(cache, regexp, length);
             return false;
         }
     }
+    regex_t *compiled=slot->value;
 
     int matches=REGEXP_MATCH_BUFFER_SIZE;
     regmatch_t matchPtr[REGEXP_MATCH_BUFFER_SIZE];
@@ -67,7 +72,16 @@ bool hstr_regexp_match(
 
 void hstr_regexp_destroy(HstrRegexp *hstrRegexp)
 {
-    hashset_destroy(&hstrRegexp->cache, true);
+    unsigned position, i;
+    RegexpCacheSlot *slot;
+    for(i=0; i<2; i++) {
+        position=0;
+        while((slot=regexp_cache_next(&hstrRegexp->cache[i], &position))!=NULL) {
+            regfree(slot->value);
+            free(slot->value);
+        }
+        regexp_cache_destroy(&hstrRegexp->cache[i]);
+    }
 }
 
 int regexp_compile(regex_t *regexp, const char *regexpText)
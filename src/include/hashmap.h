@@ -0,0 +1,239 @@
+/*
+ hashmap.h      hash maps specialized for value types
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HASHMAP_H_
+#define _HASHMAP_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hstr_arena.h"
+
+// table of capacity slots (power of 2) grows when load factor exceeds 7/8
+#define HASHMAP_MIN_CAPACITY 16
+#define HASHMAP_MAX_SIZE(CAPACITY) ((CAPACITY)/8*7)
+
+unsigned hashmap_hash(const char *key, unsigned length);
+unsigned hashmap_hash_string(const char *key, unsigned *length);
+
+/*
+ * Open addressing hash map with Robin Hood linear probing: key which is further
+ * from its home slot takes the slot of the key closer to its home. Therefore lookup
+ * can stop at the first key which is closer to its home than the searched key would be.
+ * Keys are views (pointer and length) - copies owned by the map or, if the map borrows
+ * keys, strings owned by the caller which must outlive the map. Values are stored in
+ * slots and move on insertion i.e. pointer to value is valid only until the next
+ * insertion or removal.
+ *
+ * HASHMAP_DECLARE(MAP, VALUE) declares MAP type and MAP##Slot type of its slots,
+ * HASHMAP_DEFINE(MAP, PREFIX) defines PREFIX##_ functions specialized for the map.
+ */
+#define HASHMAP_DECLARE(MAP, VALUE) \
+typedef struct { \
+    /* NULL key is an empty slot */ \
+    const char *key; \
+    VALUE value; \
+    /* full hash and length of the key to skip most key comparisons */ \
+    unsigned hash; \
+    unsigned length; \
+} MAP##Slot; \
+\
+typedef struct { \
+    MAP##Slot *slots; \
+    unsigned capacity; \
+    int currentSize; \
+    bool borrowedKeys; \
+    /* key copies */ \
+    Arena arena; \
+} MAP;
+
+#define HASHMAP_DEFINE(MAP, PREFIX) \
+/* table is allocated on the first insertion > empty map costs nothing */ \
+static inline void PREFIX##_init(MAP *map, int subsystem, bool borrowedKeys) \
+{ \
+    map->slots=NULL; \
+    map->capacity=0; \
+    map->currentSize=0; \
+    map->borrowedKeys=borrowedKeys; \
+    arena_init(&map->arena, subsystem); \
+} \
+\
+/* distance of the slot from home slot of its key */ \
+static inline unsigned PREFIX##_distance(const MAP *map, unsigned slot) \
+{ \
+    return (slot-map->slots[slot].hash)&(map->capacity-1); \
+} \
+\
+static inline MAP##Slot *PREFIX##_find(const MAP *map, const char *key, unsigned length, unsigned hash) \
+{ \
+    if(!map->capacity) { \
+        return NULL; \
+    } \
+    unsigned mask=map->capacity-1; \
+    unsigned slot=hash&mask, distance=0; \
+    while(map->slots[slot].key && PREFIX##_distance(map, slot)>=distance) { \
+        if(map->slots[slot].hash==hash && map->slots[slot].length==length \
+                && !memcmp(map->slots[slot].key, key, length)) { \
+            return &map->slots[slot]; \
+        } \
+        slot=(slot+1)&mask; \
+        distance++; \
+    } \
+    return NULL; \
+} \
+\
+/* key must not be in the table and the table must have a free slot - slot of the entry is returned */ \
+static inline MAP##Slot *PREFIX##_place(MAP *map, MAP##Slot entry) \
+{ \
+    unsigned mask=map->capacity-1; \
+    unsigned slot=entry.hash&mask, distance=0, slotDistance; \
+    MAP##Slot swap, *result=NULL; \
+    while(map->slots[slot].key) { \
+        slotDistance=PREFIX##_distance(map, slot); \
+        if(slotDistance<distance) { \
+            /* richer key is moved on */ \
+            swap=map->slots[slot]; \
+            map->slots[slot]=entry; \
+            entry=swap; \
+            distance=slotDistance; \
+            if(!result) { \
+                result=&map->slots[slot]; \
+            } \
+        } \
+        slot=(slot+1)&mask; \
+        distance++; \
+    } \
+    map->slots[slot]=entry; \
+    return result?result:&map->slots[slot]; \
+} \
+\
+static inline void PREFIX##_grow(MAP *map) \
+{ \
+    MAP##Slot *slots=map->slots; \
+    unsigned i, capacity=map->capacity; \
+    map->capacity=capacity?capacity*2:HASHMAP_MIN_CAPACITY; \
+    map->slots=calloc(map->capacity, sizeof(MAP##Slot)); \
+    if(!map->slots) { \
+        fprintf(stderr, "Unable to allocate hash map!"); \
+        exit(EXIT_FAILURE); \
+    } \
+    arena_account(map->arena.subsystem, sizeof(MAP##Slot)*map->capacity, true); \
+    for(i=0; i<capacity; i++) { \
+        if(slots[i].key) { \
+            PREFIX##_place(map, slots[i]); \
+        } \
+    } \
+    if(slots) { \
+        arena_account(map->arena.subsystem, sizeof(MAP##Slot)*capacity, false); \
+        free(slots); \
+    } \
+} \
+\
+/* table is sized for count keys up front - keys added in slot order of a bigger table would cluster while it grows */ \
+static inline void PREFIX##_reserve(MAP *map, unsigned count) \
+{ \
+    while(HASHMAP_MAX_SIZE(map->capacity)<count) { \
+        PREFIX##_grow(map); \
+    } \
+} \
+\
+static inline MAP##Slot *PREFIX##_get(const MAP *map, const char *key, unsigned length) \
+{ \
+    return PREFIX##_find(map, key, length, hashmap_hash(key, length)); \
+} \
+\
+/* slot of the key with hash - key which is not in the map is added with zeroed value */ \
+static inline MAP##Slot *PREFIX##_put_hashed(MAP *map, const char *key, unsigned length, unsigned hash, bool *added) \
+{ \
+    MAP##Slot *slot=PREFIX##_find(map, key, length, hash); \
+    if((*added=!slot)) { \
+        if(map->currentSize+1>HASHMAP_MAX_SIZE(map->capacity)) { \
+            PREFIX##_grow(map); \
+        } \
+        MAP##Slot entry; \
+        memset(&entry, 0, sizeof(entry)); \
+        if(map->borrowedKeys) { \
+            entry.key=key; \
+        } else { \
+            char *copy=arena_alloc(&map->arena, length+1); \
+            memcpy(copy, key, length); \
+            copy[length]=0; \
+            entry.key=copy; \
+        } \
+        entry.hash=hash; \
+        entry.length=length; \
+        slot=PREFIX##_place(map, entry); \
+        map->currentSize++; \
+    } \
+    return slot; \
+} \
+\
+static inline MAP##Slot *PREFIX##_put(MAP *map, const char *key, unsigned length, bool *added) \
+{ \
+    return PREFIX##_put_hashed(map, key, length, hashmap_hash(key, length), added); \
+} \
+\
+static inline bool PREFIX##_remove(MAP *map, const char *key, unsigned length) \
+{ \
+    MAP##Slot *found=PREFIX##_get(map, key, length); \
+    if(!found) { \
+        return false; \
+    } \
+    if(!map->borrowedKeys) { \
+        arena_free(&map->arena, (char*)found->key, length+1); \
+    } \
+    /* keys which follow are shifted back towards their home slots */ \
+    unsigned mask=map->capacity-1; \
+    unsigned slot=found-map->slots, next=(slot+1)&mask; \
+    while(map->slots[next].key && PREFIX##_distance(map, next)) { \
+        map->slots[slot]=map->slots[next]; \
+        slot=next; \
+        next=(next+1)&mask; \
+    } \
+    map->slots[slot].key=NULL; \
+    map->currentSize--; \
+    return true; \
+} \
+\
+/* next occupied slot from position (NULL when iterated) - map must not be modified meanwhile */ \
+static inline MAP##Slot *PREFIX##_next(const MAP *map, unsigned *position) \
+{ \
+    while(*position<map->capacity) { \
+        if(map->slots[(*position)++].key) { \
+            return &map->slots[*position-1]; \
+        } \
+    } \
+    return NULL; \
+} \
+\
+/* values are not released - iterate the map to release them first */ \
+static inline void PREFIX##_destroy(MAP *map) \
+{ \
+    if(map->slots) { \
+        arena_account(map->arena.subsystem, sizeof(MAP##Slot)*map->capacity, false); \
+        free(map->slots); \
+    } \
+    arena_release(&map->arena); \
+    map->slots=NULL; \
+    map->capacity=0; \
+    map->currentSize=0; \
+}
+
+#endif
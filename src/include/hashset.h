@@ -24,31 +24,42 @@
 #include <string.h>
 #include <stdbool.h>
 
-#define HASH_MAP_SIZE 10007
+#include "hashmap.h"
 
-struct HashSetNode {
-    char *key;
-    void *value;
-    struct HashSetNode *next;
-};
+/*
+ * Hash set of strings (keys) with optional pointer values i.e. hash map of void*
+ * values - see hashmap.h. Keys are copied unless the set borrows them.
+ */
+HASHMAP_DECLARE(HashSet, void*)
 
+// keys are iterated in slot order w/o allocation - set must not be modified meanwhile
 typedef struct {
-    struct HashSetNode *lists[HASH_MAP_SIZE];
-    int currentSize;
-} HashSet;
+    const HashSet *hs;
+    unsigned slot;
+} HashSetIterator;
 
 void hashset_init(HashSet *hs);
+void hashset_init_arena(HashSet *hs, int subsystem);
+void hashset_init_borrowed(HashSet *hs, int subsystem);
+void hashset_reserve(HashSet *hs, unsigned count);
 
 int hashset_contains(const HashSet *hs, const char *key);
+int hashset_contains_hashed(const HashSet *hs, const char *key, unsigned length, unsigned hash);
 int hashset_add(HashSet *hs, const char *key);
 int hashset_size(const HashSet *hs);
-char** hashset_keys(const HashSet *hs);
 
 void *hashset_get(const HashSet *hm, const char *key);
+void *hashset_get_view(const HashSet *hm, const char *key, unsigned length);
+void *hashset_get_hashed(const HashSet *hm, const char *key, unsigned length, unsigned hash);
 int hashset_put(HashSet *hm, const char *key, void *value);
-int hashset_remove(const HashSet *hm, const char *key);
+int hashset_put_view(HashSet *hm, const char *key, unsigned length, void *value);
+int hashset_put_hashed(HashSet *hm, const char *key, unsigned length, unsigned hash, void *value);
+int hashset_remove(HashSet *hm, const char *key);
 void hashset_stat(const HashSet *hm);
 
+void hashset_iterator_init(HashSetIterator *it, const HashSet *hs);
+const char *hashset_iterator_next(HashSetIterator *it, unsigned *length, void **value);
+
 void hashset_destroy(HashSet *hs, const bool freeValues);
 
 #endif
@@ -0,0 +1,70 @@
+/*
+ hstr_arena.h       header file for region allocator with per subsystem accounting
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_ARENA_H
+#define _HSTR_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// subsystems whose memory is accounted
+#define ARENA_HISTORY    0
+#define ARENA_RANKING    1
+#define ARENA_HASHSET    2
+#define ARENA_FAVORITES  3
+#define ARENA_BLACKLIST  4
+#define ARENA_SELECTION  5
+#define ARENA_SUBSYSTEMS 6
+
+// blocks grow from min to max size so that small arenas stay small
+#define ARENA_MIN_BLOCK_SIZE (1<<10)
+#define ARENA_BLOCK_SIZE (1<<16)
+#define ARENA_ALIGNMENT 8
+// released allocations are reused by size classes (powers of two)
+#define ARENA_SIZE_CLASSES 32
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+} ArenaBlock;
+
+/*
+ * Region of many small allocations which are bump-allocated from big blocks and freed
+ * all at once. Allocations released before that are kept on free lists of their size
+ * class to be reused.
+ */
+typedef struct {
+    ArenaBlock *blocks;
+    char *next;
+    char *end;
+    void *freeLists[ARENA_SIZE_CLASSES];
+    size_t blockSize;
+    int subsystem;
+} Arena;
+
+void arena_init(Arena *arena, int subsystem);
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strdup(Arena *arena, const char *s);
+void arena_free(Arena *arena, void *p, size_t size);
+void arena_release(Arena *arena);
+
+void arena_account(int subsystem, size_t size, bool held);
+size_t arena_size(int subsystem);
+void arena_stat();
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ hstr_candidates.h  header file for stack of candidates of incrementally typed pattern
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_CANDIDATES_H
+#define _HSTR_CANDIDATES_H
+
+#include <stdbool.h>
+
+/*
+ * Source items matching one pattern. Indices of items which start with the pattern
+ * are followed by indices of items which contain it elsewhere - both runs in source
+ * order i.e. ascending. Offsets of the pattern in the items are kept along w/ them.
+ */
+typedef struct {
+    // pattern as it's matched i.e. case folded unless search is case sensitive
+    char *pattern;
+    unsigned patternLength;
+    unsigned *ids;
+    unsigned *offsets;
+    unsigned prefixCount;
+    unsigned count;
+} CandidateLevel;
+
+// levels of patterns each of which extends the pattern of the level below it
+typedef struct {
+    CandidateLevel *levels;
+    unsigned depth;
+    unsigned capacity;
+
+    // source the levels index into and how it was matched
+    char **source;
+    unsigned sourceCount;
+    int view;
+    int match;
+    int caseSensitive;
+} CandidateStack;
+
+void candidates_init(CandidateStack *stack);
+bool candidates_validate(CandidateStack *stack, char **source, unsigned sourceCount, int view, int match, int caseSensitive);
+CandidateLevel *candidates_narrowest(CandidateStack *stack, const char *pattern, unsigned patternLength);
+CandidateLevel *candidates_push(CandidateStack *stack, const char *pattern, unsigned patternLength, unsigned maxCount);
+void candidates_clear(CandidateStack *stack);
+void candidates_destroy(CandidateStack *stack);
+
+#endif
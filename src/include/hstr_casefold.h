@@ -0,0 +1,26 @@
+/*
+ hstr_casefold.h    header file for case folding of history items
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_CASEFOLD_H
+#define _HSTR_CASEFOLD_H
+
+#include <stddef.h>
+
+void casefold(char *folded, const char *text, size_t size);
+
+#endif
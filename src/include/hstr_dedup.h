@@ -0,0 +1,55 @@
+/*
+ hstr_dedup.h       header file for deduplication of selected commands
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_DEDUP_H
+#define _HSTR_DEDUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hstr_arena.h"
+#include "hstr_intern.h"
+
+/*
+ * Command is selected only if the bit of its id is not set yet. Ids are dense i.e. the
+ * bitset is as big as the number of unique commands: ranked items are identified by their
+ * index, raw items by the id of their command (see HistoryItems) and the others (paged raw
+ * history, favorites) by ids interned for one selection. Every word of bitset is stamped
+ * by generation of the selection which set it i.e. words of previous selections read as
+ * zero and the bitset is cleared in constant time.
+ */
+typedef struct {
+    // copies of commands w/o dense id interned by the current selection
+    InternTable commands;
+    Arena copies;
+    bool interned;
+
+    uint64_t *bits;
+    unsigned *stamps;
+    size_t words;
+    unsigned generation;
+} SelectionDedup;
+
+void dedup_init(SelectionDedup *dedup);
+void dedup_begin(SelectionDedup *dedup);
+unsigned dedup_intern(SelectionDedup *dedup, const char *command, unsigned length);
+bool dedup_add(SelectionDedup *dedup, unsigned id);
+void dedup_destroy(SelectionDedup *dedup);
+
+#endif
@@ -33,6 +33,8 @@ typedef struct {
     unsigned count;
     bool loaded;
     HashSet *set;
+    // favorite items
+    Arena arena;
 } FavoriteItems;
 
 void favorites_init(FavoriteItems *favorites);
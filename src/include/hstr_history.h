@@ -30,26 +30,88 @@
 #include "hstr_favorites.h"
 #include "hstr_utils.h"
 #include "hashset.h"
+#include "hstr_ranking.h"
 #include "radixsort.h"
 
 #define ENV_VAR_HISTFILE "HISTFILE"
+// colon separated glob patterns of history files to be merged with HISTFILE
+#define ENV_VAR_HH_HISTORY_SOURCES "HH_HISTORY_SOURCES"
 
 #define FILE_DEFAULT_HISTORY ".bash_history"
 #define FILE_ZSH_HISTORY ".zsh_history"
 
-#define ZSH_HISTORY_ITEM_OFFSET 15
-#define BASH_HISTORY_ITEM_OFFSET 0
+// ranked view: number of top ranked commands ordered before the view is shown
+#define HISTORY_RANKED_TOP 256
+// ranked view: ordered commands grow by this factor as scans consume them
+#define HISTORY_RANKED_GROWTH 8
+
+// memory budget mode: number of top ranked commands kept in memory
+#define HISTORY_MEMORY_BUDGET_ITEMS 10000
+// memory budget mode: lexed pages of raw history are released after this many items are scanned
+#define HISTORY_RAW_RETAIN_PERIOD 1024
+
+// part of history file which starts and ends at record boundary
+typedef struct {
+    size_t offset;
+    size_t size;
+    // timestamp in effect at the beginning of the page
+    unsigned timestamp;
+    // number of commands before the page and in the page (in history file order)
+    unsigned first;
+    unsigned count;
+    // lexed copy of the page and its commands (NULL if the page is not lexed)
+    char *lexed;
+    char **items;
+} HistoryRawPage;
+
+// raw history paged from read-only mapped history file on demand
+typedef struct {
+    char *buffer;
+    size_t size;
+    int format;
+    bool hasTimestamps;
+    HistoryRawPage *pages;
+    unsigned count;
+    // indices of lexed pages
+    unsigned *lexed;
+    unsigned lexedCount;
+} HistoryRawPages;
 
 typedef struct {
-    // ranked history
+    // unique items packed to one blob of NUL terminated strings - ranked items first
+    char *corpus;
+    size_t corpusSize;
+    // case folded copy of corpus (see casefold()) - item's folded copy is at the same offset
+    char *foldedCorpus;
+    // ranked history (items point to corpus) with lengths and hashes (see hashmap_hash()) of items
     char **items;
+    unsigned *lengths;
+    unsigned *hashes;
+    // ranks are set once all items are in their final order
+    unsigned *ranks;
     unsigned count;
-    // raw history
+    // only the first rankedCount items are in their final order - the rest is ordered
+    // by rank keys on history_rank_items() (rank keys are kept until index is saved)
+    unsigned rankedCount;
+    uint64_t *rankKeys;
+    // raw history (items point to corpus) with epoch timestamps (0 if unknown)
     char **rawItems;
+    unsigned *rawLengths;
+    unsigned *rawTimestamps;
+    // dense ids of commands of raw items: ids below count are commands of ranked items
+    unsigned *rawIds;
     unsigned rawCount;
+    // raw history is paged instead of raw items in memory budget mode
+    HistoryRawPages *rawPages;
 } HistoryItems;
 
-HistoryItems *get_prioritized_history(int optionBigKeys, HashSet *blacklist);
+HistoryItems *get_prioritized_history(int ranking, HashSet *blacklist, bool memoryBudget);
+HistoryItems *get_prioritized_history_progressively(int ranking, HashSet *blacklist, bool memoryBudget);
+bool history_is_loading();
+HistoryItems *history_finish_loading(bool wait);
+void history_rank_items(HistoryItems *history, unsigned count);
+bool history_index_pending();
+void history_save_index();
 
 HistoryItems *get_history_items();
 void free_history_items();
@@ -58,9 +120,13 @@ HistoryItems *prioritize_history(HistoryItems *historyFileItems);
 void free_prioritized_history();
 
 void history_mgmt_open();
+void history_mgmt_load_system_history();
 void history_clear_dirty();
 int history_mgmt_remove_from_system_history(char *cmd);
 int history_mgmt_remove_from_raw(char *cmd, HistoryItems *history);
+char *history_raw_item(HistoryItems *history, unsigned i);
+char *history_folded_item(HistoryItems *history, char *item);
+void history_raw_retain(HistoryItems *history, char **items, unsigned count);
 int history_mgmt_remove_from_ranked(char *cmd, HistoryItems *history);
 void history_mgmt_flush();
 
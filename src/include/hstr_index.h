@@ -0,0 +1,90 @@
+/*
+ hstr_index.h       header file for persistent index of ranked history
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_INDEX_H_
+#define _HSTR_INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "hashset.h"
+#include "hstr_history.h"
+
+#define FILE_HH_INDEX ".hh_index"
+
+#define HH_INDEX_MAGIC "HHIX"
+#define HH_INDEX_VERSION 12
+
+#define HH_INDEX_INVALID 0
+#define HH_INDEX_CURRENT 1
+#define HH_INDEX_PREFIX  2
+
+// hash of words of empty prefix (see history_index_checksum_words())
+#define HH_INDEX_CHECKSUM_BASIS 14695981039346656037ull
+
+/*
+ * Index file layout (native byte order):
+ *   header | ranked item offsets (u32) | lengths (u32) | hashes (u32) | ranks (u32) | last occurrences (u32)
+ *          | raw item offsets (u32) | raw item lengths (u32) | raw item timestamps (u32) | raw item ids (u32)
+ *          | corpus | folded corpus
+ * Corpus is the packed corpus of history items i.e. raw items share strings
+ * with ranked items. Folded corpus is its case folded copy of the same size.
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t historyDevice;
+    uint64_t historyInode;
+    uint64_t historySize;
+    int64_t historyMtime;
+    int64_t historyMtimeNsec;
+    uint64_t indexedSize;
+    uint64_t indexedChecksum;
+    uint32_t fingerprint;
+    uint32_t lineCount;
+    uint32_t hasTimestamps;
+    uint32_t count;
+    uint32_t rawCount;
+    uint32_t lastTimestamp;
+    uint64_t blobSize;
+} HistoryIndexHeader;
+
+// ranking state needed to continue indexing of history appended to the file
+typedef struct {
+    uint64_t indexedSize;
+    uint64_t indexedChecksum;
+    // hash of whole words of indexed prefix - checksum is continued from it when history is appended
+    uint64_t indexedWords;
+    unsigned lineCount;
+    bool hasTimestamps;
+    unsigned lastTimestamp;
+    unsigned *ranks;
+    unsigned *lastOccurrences;
+} HistoryIndexState;
+
+uint64_t history_index_checksum_words(uint64_t words, const char *buffer, size_t begin, size_t end);
+uint64_t history_index_checksum_finish(uint64_t words, const char *buffer, size_t size);
+unsigned history_index_fingerprint(int format, int ranking, HashSet *blacklist);
+int history_index_load(const char *historyFileName, const struct stat *historyStat, unsigned fingerprint,
+        HistoryIndexState *state, HistoryItems *history);
+void history_index_save(const struct stat *historyStat, unsigned fingerprint, HistoryIndexState *state,
+        HistoryItems *history);
+void history_index_close();
+
+#endif
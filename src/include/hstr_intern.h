@@ -0,0 +1,63 @@
+/*
+ hstr_intern.h      header file for string interning
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_INTERN_H
+#define _HSTR_INTERN_H
+
+#include "hashset.h"
+
+#define INTERN_ID_NONE 0xFFFFFFFFu
+
+/*
+ * Interned strings are borrowed views (pointer and length) of strings owned by
+ * the caller e.g. lines of history corpus. Every distinct string gets 32b id -
+ * ids are given in order of the first interning starting with 0.
+ */
+typedef struct {
+    // string > id+1
+    HashSet ids;
+    const char **strings;
+    unsigned *lengths;
+    unsigned *hashes;
+    unsigned count;
+    unsigned capacity;
+} InternTable;
+
+void intern_init(InternTable *table, int subsystem);
+unsigned intern_id(InternTable *table, const char *string, unsigned length);
+unsigned intern_id_hashed(InternTable *table, const char *string, unsigned length, unsigned hash);
+unsigned intern_lookup(const InternTable *table, const char *string, unsigned length);
+unsigned intern_lookup_hashed(const InternTable *table, const char *string, unsigned length, unsigned hash);
+void intern_destroy(InternTable *table);
+
+static inline const char *intern_string(const InternTable *table, unsigned id)
+{
+    return table->strings[id];
+}
+
+static inline unsigned intern_length(const InternTable *table, unsigned id)
+{
+    return table->lengths[id];
+}
+
+static inline unsigned intern_hash(const InternTable *table, unsigned id)
+{
+    return table->hashes[id];
+}
+
+#endif
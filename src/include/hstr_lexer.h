@@ -0,0 +1,55 @@
+/*
+ hstr_lexer.h       header file for lexer of BASH and zsh history files
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_LEXER_H
+#define _HSTR_LEXER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HISTORY_FORMAT_BASH 0
+#define HISTORY_FORMAT_ZSH  1
+
+// zsh metafies bytes special to its line editor as Meta followed by byte^32
+#define ZSH_META 0x83
+
+typedef struct {
+    char *p;
+    char *end;
+    int format;
+    // file starts with a timestamp > #<digit> lines are timestamps rather than entries
+    bool hasTimestamps;
+    // timestamp in effect i.e. of the last timestamp seen
+    unsigned timestamp;
+} HistoryLexer;
+
+typedef struct {
+    // NUL terminated command or NULL for timestamp which is an entry of readline history
+    char *command;
+    unsigned timestamp;
+} HistoryRecord;
+
+void history_lexer_init(HistoryLexer *lexer, char *begin, char *end, int format, bool hasTimestamps, unsigned timestamp);
+bool history_lexer_next(HistoryLexer *lexer, HistoryRecord *record);
+char *history_lexer_record_end(char *begin, char *p, char *end, int format);
+
+bool history_lexer_bash_timestamp(const char *line, unsigned *timestamp);
+char *history_lexer_zsh_command(char *line, unsigned *timestamp);
+size_t history_lexer_unmetafy(char *command, size_t length);
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ hstr_matcher.h     header file for substring matcher of history items
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_MATCHER_H
+#define _HSTR_MATCHER_H
+
+#define MATCHER_NONE -1
+
+/*
+ * Needle compiled for repeated search in history items. Search is case sensitive -
+ * case insensitive search matches case folded needle against case folded items.
+ */
+typedef struct {
+    char *needle;
+    unsigned length;
+    // offsets of the two rarest needle bytes (ascending) which filter candidate positions
+    unsigned filterOffsets[2];
+    // filter bytes broadcast to vector width once for all searches
+    unsigned char filters[2][32];
+} Matcher;
+
+void matcher_init(Matcher *matcher, const char *needle, unsigned length);
+int matcher_find(const Matcher *matcher, const char *haystack, unsigned length);
+const char *matcher_kernel_name();
+void matcher_destroy(Matcher *matcher);
+
+#endif
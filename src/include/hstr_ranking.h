@@ -0,0 +1,131 @@
+/*
+ hstr_ranking.h     header file for ranking of history items
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_RANKING_H
+#define _HSTR_RANKING_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// metric used to rank history items
+#define HISTORY_RANKING_ORDER      0
+#define HISTORY_RANKING_TIME_DECAY 1
+#define HISTORY_RANKING_ADDITIVE   2
+#define HISTORY_RANKING_FREQUENCY  3
+
+// weight of command occurrence in time-decay ranking halves every day
+#define HISTORY_TIME_DECAY_HALF_LIFE 86400
+// older occurrence adds less than half a second to time-decay rank
+#define HISTORY_TIME_DECAY_HORIZON (18*HISTORY_TIME_DECAY_HALF_LIFE)
+
+// floor(10*ln(order)) of 32b orders is at most 221
+#define RANKING_LOG_VALUES 222
+
+extern const uint64_t rankingLogThresholds[RANKING_LOG_VALUES+1];
+extern const unsigned char rankingLogOfPowers[32];
+
+unsigned ranking_time_decay(unsigned rank, unsigned timestamp);
+
+/*
+ * Rank functions fold occurrences of a history item to its rank: rank of the item
+ * is passed with the order (line number) and timestamp of its next occurrence
+ * (first occurrence is ranked from 0). Ranks saturate at UINT_MAX.
+ */
+
+static inline unsigned ranking_saturate(uint64_t rank)
+{
+    return rank<UINT_MAX?(unsigned)rank:UINT_MAX;
+}
+
+// floor(10*ln(order)) of order>0 - orders of the same bit length differ in at most 7 values
+static inline unsigned ranking_log(unsigned order)
+{
+    unsigned value=rankingLogOfPowers[31-__builtin_clz(order)];
+    while(order>=rankingLogThresholds[value+1]) {
+        value++;
+    }
+    return value;
+}
+
+// recent occurrences weigh more, but only logarithmically (default)
+static inline unsigned ranking_log_order(unsigned rank, unsigned order, unsigned timestamp, size_t length)
+{
+    // ln(0) is -inf > the first line of history isn't ranked
+    if(!order) {
+        return rank;
+    }
+    return ranking_saturate((uint64_t)rank+ranking_log(order)+length);
+}
+
+static inline unsigned ranking_additive(unsigned rank, unsigned order, unsigned timestamp, size_t length)
+{
+    return ranking_saturate((uint64_t)rank+order/10+length);
+}
+
+static inline unsigned ranking_frequency(unsigned rank, unsigned order, unsigned timestamp, size_t length)
+{
+    return ranking_saturate((uint64_t)rank+1);
+}
+
+static inline unsigned ranking_time_decay_occurrence(unsigned rank, unsigned order, unsigned timestamp, size_t length)
+{
+    return ranking_time_decay(rank, timestamp);
+}
+
+// rank is the sum of contributions of occurrences i.e. occurrences can be ranked in any order
+static inline bool ranking_accumulates(int ranking)
+{
+    return ranking!=HISTORY_RANKING_TIME_DECAY;
+}
+
+static inline unsigned ranking_rank(int ranking, unsigned rank, unsigned order, unsigned timestamp, size_t length)
+{
+    switch(ranking) {
+    case HISTORY_RANKING_TIME_DECAY:
+        return ranking_time_decay_occurrence(rank, order, timestamp, length);
+    case HISTORY_RANKING_ADDITIVE:
+        return ranking_additive(rank, order, timestamp, length);
+    case HISTORY_RANKING_FREQUENCY:
+        return ranking_frequency(rank, order, timestamp, length);
+    default:
+        return ranking_log_order(rank, order, timestamp, length);
+    }
+}
+
+/*
+ * Ranking loop LOOP(RANK) is compiled once for each metric with RANK being its rank
+ * function > metric is chosen once per loop rather than once per history line.
+ */
+#define RANKING_SPECIALIZE(RANKING, LOOP) \
+    switch(RANKING) { \
+    case HISTORY_RANKING_TIME_DECAY: \
+        LOOP(ranking_time_decay_occurrence); \
+        break; \
+    case HISTORY_RANKING_ADDITIVE: \
+        LOOP(ranking_additive); \
+        break; \
+    case HISTORY_RANKING_FREQUENCY: \
+        LOOP(ranking_frequency); \
+        break; \
+    default: \
+        LOOP(ranking_log_order); \
+    }
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ hstr_rankmap.h     header file for concurrent rank map
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef _HSTR_RANKMAP_H
+#define _HSTR_RANKMAP_H
+
+#include <pthread.h>
+
+#include "hashmap.h"
+
+// shard is chosen by high bits of key hash, slot in shard by its low bits
+#define RANKMAP_SHARD_BITS 6
+#define RANKMAP_SHARDS (1<<RANKMAP_SHARD_BITS)
+#define RANKMAP_NONE 0xFFFFFFFFu
+
+typedef struct {
+    unsigned rank;
+    unsigned lastOccurrence;
+} RankAccumulator;
+
+HASHMAP_DECLARE(RankShardMap, RankAccumulator)
+HASHMAP_DECLARE(FrozenRankIndex, unsigned)
+
+// shards are aligned to cache lines so that threads don't contend for lines of other shards
+typedef struct {
+    pthread_mutex_t lock;
+    RankShardMap map;
+} __attribute__((aligned(64))) RankShard;
+
+/*
+ * Rank map which is updated by many threads at once: keys are split to shards with
+ * their own lock. Contributions of occurrences to ranks are accumulated, therefore
+ * only ranking functions which add contribution of each occurrence to rank (i.e.
+ * don't depend on the order of occurrences) can be used. Keys are borrowed.
+ */
+typedef struct {
+    RankShard shards[RANKMAP_SHARDS];
+} ConcurrentRankMap;
+
+/*
+ * Read-only rank map: items sorted by last occurrence (most recent first, ties by key)
+ * i.e. its content doesn't depend on how threads interleaved, and index of items by key.
+ */
+typedef struct {
+    const char **items;
+    unsigned *lengths;
+    unsigned *hashes;
+    unsigned *ranks;
+    unsigned *lastOccurrences;
+    unsigned count;
+    FrozenRankIndex index;
+} FrozenRankMap;
+
+ConcurrentRankMap *concurrent_rankmap_new(int subsystem);
+void concurrent_rankmap_add(ConcurrentRankMap *map, const char *key, unsigned length, unsigned hash,
+        unsigned contribution, unsigned order);
+void concurrent_rankmap_freeze(ConcurrentRankMap *map, FrozenRankMap *frozen);
+
+unsigned frozen_rankmap_find(const FrozenRankMap *frozen, const char *key, unsigned length);
+void frozen_rankmap_destroy(FrozenRankMap *frozen);
+
+#endif
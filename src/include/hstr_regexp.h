@@ -23,11 +23,15 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-#include "hashset.h"
+#include "hashmap.h"
+
+// compiled regexps are owned by the cache as slots are moved when it grows
+HASHMAP_DECLARE(RegexpCache, regex_t*)
 
 typedef struct {
     bool caseSensitive;
-    HashSet cache;
+    // regexps compiled case insensitive and case sensitive
+    RegexpCache cache[2];
 } HstrRegexp;
 
 void hstr_regexp_init(HstrRegexp *hstrRegexp);
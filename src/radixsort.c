@@ -16,223 +16,115 @@
  limitations under the License.
 */
 
-#include "include/radixsort.h"
-
-#define GET_TOP_INDEX(KEY) KEY/RADIX_SLOT_SIZE
-#define GET_LOW_INDEX(KEY) KEY%RADIX_SLOT_SIZE
-
-void radixsort_init(RadixSorter *rs, unsigned keyLimit)
-{
-    rs->optionBigKeys=RADIX_BIG_KEYS_SKIP;
-
-    rs->_topIndexLimit=GET_TOP_INDEX(keyLimit);
-    rs->size=0;
-    rs->topDigits=malloc(rs->_topIndexLimit * sizeof(RadixItem ***));
-    memset(rs->topDigits, 0, rs->_topIndexLimit * sizeof(RadixItem ***));
-    rs->maxKey=0;
-    rs->keyLimit=keyLimit;
-
-    rs->_slotDescriptors=malloc(rs->_topIndexLimit * sizeof(RadixSlot **));
-    rs->_slotsCount=0;
-}
+#include <stdlib.h>
+#include <string.h>
 
-void radixsort_set_debug_level(RadixSorter *rs, unsigned debugLevel)
-{
-    rs->_debug=debugLevel;
-}
-
-RadixItem **radixsort_get_slot(RadixSorter *rs, unsigned topIndex)
-{
-    RadixItem **slot=malloc(RADIX_SLOT_SIZE * sizeof(RadixItem *));
-    memset(slot, 0, RADIX_SLOT_SIZE * sizeof(RadixItem *));
-
-    RadixSlot *descriptor=malloc(sizeof(RadixSlot));
-    descriptor->min=rs->keyLimit;
-    descriptor->max=0;
-    descriptor->size=0;
+#include "include/radixsort.h"
 
-    rs->_slotDescriptors[topIndex]=descriptor;
-    rs->_slotsCount++;
-    return slot;
-}
+#define RADIX_DIGIT_BITS 8
+#define RADIX_DIGITS (1<<RADIX_DIGIT_BITS)
 
-void radixsort_add(RadixSorter *rs, RadixItem *item)
+/*
+ * Items are sorted by 64-bit keys in descending order in bulk: stable LSD radix sort
+ * permutes keys along with items one byte of keys after another. Bytes in which all
+ * keys agree (e.g. high bytes of small keys) are skipped, therefore the number of passes
+ * adapts to the range of keys.
+ */
+void radixsort_sort(uint64_t *keys, void **items, unsigned count)
 {
-    if(item->key > rs->keyLimit) {
-        if(rs->_debug > RADIX_DEBUG_LEVEL_NONE) {
-            fprintf(stderr, "WARNING: Radix sort overflow - inserted key is bigger than limit (%u): %u\n", rs->keyLimit, item->key);
+    if(count<2) {
+        return;
+    }
+    uint64_t *sortedKeys=malloc(count * sizeof(uint64_t)), *swapKeys;
+    void **sortedItems=malloc(count * sizeof(void*)), **swapItems;
+    uint64_t *originalKeys=keys;
+    void **originalItems=items;
+    unsigned counts[RADIX_DIGITS];
+    unsigned i, digit, shift, offset, position;
+    for(shift=0; shift<64; shift+=RADIX_DIGIT_BITS) {
+        memset(counts, 0, sizeof(counts));
+        for(i=0; i<count; i++) {
+            counts[(keys[i]>>shift)&(RADIX_DIGITS-1)]++;
         }
-        if(rs->optionBigKeys==RADIX_BIG_KEYS_FLOOR) {
-            item->key = rs->keyLimit-1;
-        } else {
-            if(rs->optionBigKeys==RADIX_BIG_KEYS_SKIP) {
-                return;
-            } else {
-                exit(0);
-            }
+        if(counts[(keys[0]>>shift)&(RADIX_DIGITS-1)]==count) {
+            continue;
         }
+        // descending order > offsets of digits are assigned from the biggest one
+        for(digit=RADIX_DIGITS, offset=0; digit>0; digit--) {
+            unsigned digitCount=counts[digit-1];
+            counts[digit-1]=offset;
+            offset+=digitCount;
+        }
+        for(i=0; i<count; i++) {
+            position=counts[(keys[i]>>shift)&(RADIX_DIGITS-1)]++;
+            sortedKeys[position]=keys[i];
+            sortedItems[position]=items[i];
+        }
+        swapKeys=keys; keys=sortedKeys; sortedKeys=swapKeys;
+        swapItems=items; items=sortedItems; sortedItems=swapItems;
     }
-
-    unsigned topIndex = GET_TOP_INDEX(item->key);
-    unsigned lowIndex = GET_LOW_INDEX(item->key);
-
-    if(!rs->topDigits[topIndex]) {
-        rs->topDigits[topIndex]=radixsort_get_slot(rs, topIndex);
-    }
-
-    RadixItem *chain=rs->topDigits[topIndex][lowIndex];
-    rs->topDigits[topIndex][lowIndex]=item;
-    if(chain==NULL) {
-        item->next=NULL;
+    if(keys!=originalKeys) {
+        memcpy(originalKeys, keys, count * sizeof(uint64_t));
+        memcpy(originalItems, items, count * sizeof(void*));
+        free(keys);
+        free(items);
     } else {
-        item->next=chain;
+        free(sortedKeys);
+        free(sortedItems);
     }
-
-    rs->size++;
-    rs->maxKey=MAX(rs->maxKey,item->key);
-    rs->_slotDescriptors[topIndex]->min=MIN(rs->_slotDescriptors[topIndex]->min,item->key);
-    rs->_slotDescriptors[topIndex]->max=MAX(rs->_slotDescriptors[topIndex]->max,item->key);
-    rs->_slotDescriptors[topIndex]->size++;
 }
 
-void radix_dec_slot_descriptor_size(RadixSorter *rs, RadixSlot *descriptor, unsigned key, unsigned topIndex)
+static inline void radixsort_swap(uint64_t *keys, void **items, unsigned a, unsigned b)
 {
-    descriptor->size--;
-    if(!descriptor->size) {
-        descriptor->min=rs->keyLimit;
-        descriptor->max=0;
-    } else {
-        if(descriptor->size==1) {
-            if(rs->topDigits[topIndex][GET_LOW_INDEX(descriptor->max)]) {
-                descriptor->min=descriptor->max;
-            } else {
-                if(rs->topDigits[topIndex][GET_LOW_INDEX(descriptor->min)]) {
-                    descriptor->max=descriptor->min;
-                }
-            }
-        }
-    }
+    uint64_t key=keys[a];
+    keys[a]=keys[b];
+    keys[b]=key;
+    void *item=items[a];
+    items[a]=items[b];
+    items[b]=item;
 }
 
-RadixItem *radix_cut(RadixSorter *rs, unsigned key, void *data)
+/*
+ * Items are partitioned so that items with the top count keys come first (in no particular
+ * order) w/o sorting the rest. Range of candidates is narrowed down by MSD radix partitioning:
+ * candidates are split by the highest byte in which their keys differ to bigger keys
+ * (selected), keys with the cut-off byte (candidates) and smaller keys (dropped).
+ */
+void radixsort_select(uint64_t *keys, void **items, unsigned size, unsigned count)
 {
-    // TODO optimization: fix min/max on cut of a value
-    if(key <= rs->maxKey) {
-        unsigned topIndex = GET_TOP_INDEX(key);
-        unsigned lowIndex = GET_LOW_INDEX(key);
-
-        if(rs->topDigits[topIndex]) {
-            RadixItem *ri=rs->topDigits[topIndex][lowIndex];
-            RadixItem *lastRi=NULL;
-            while(ri->data!=data) {
-                if(ri->next) {
-                    lastRi=ri;
-                    ri=ri->next;
-                } else {
-                    break;
-                }
-            }
-            if(ri->data==data) {
-                if(lastRi) {
-                    lastRi->next=ri->next;
-                } else {
-                    rs->topDigits[topIndex][lowIndex]=ri->next;
-                }
-                ri->next=NULL;
-                rs->size--;
-                radix_dec_slot_descriptor_size(rs, rs->_slotDescriptors[topIndex], key, topIndex);
-                return ri;
-            }
+    unsigned counts[RADIX_DIGITS];
+    unsigned begin=0, end=size, i, digit, shift, bigger, lo, mid, hi;
+    uint64_t keysOr, keysAnd;
+    while(begin<count && count<end) {
+        keysOr=0;
+        keysAnd=UINT64_MAX;
+        for(i=begin; i<end; i++) {
+            keysOr|=keys[i];
+            keysAnd&=keys[i];
         }
-    }
-    return NULL;
-}
-
-RadixItem **radixsort_dump(RadixSorter *rs)
-{
-    if(rs->size>0) {
-        RadixItem **result=malloc(rs->size * sizeof(RadixItem *));
-        int t = GET_TOP_INDEX(rs->maxKey);
-        int slotMin, slotSize, slotCount, l;
-        unsigned items=0;
-        do {
-            if(rs->topDigits[t]) {
-                if(rs->_slotDescriptors[t]->size>0) {
-                    l=GET_LOW_INDEX(rs->_slotDescriptors[t]->max);
-                    slotMin=GET_LOW_INDEX(rs->_slotDescriptors[t]->min);
-                    slotSize=rs->_slotDescriptors[t]->size;
-                    slotCount=0;
-                    do {
-                        if(rs->topDigits[t][l]) {
-                            result[items++]=rs->topDigits[t][l];
-                            slotCount++;
-                            RadixItem *ri=rs->topDigits[t][l]->next;
-                            while(ri) {
-                                result[items++]=ri;
-                                slotCount++;
-                                ri=ri->next;
-                            }
-                        }
-                    } while(--l>=slotMin && slotCount<slotSize);
-                }
-            }
-        } while(--t>=0);
-        return result;
-    }
-    return NULL;
-}
-
-void radixsort_stat(RadixSorter *rs, bool listing)
-{
-    printf("\n Radixsort (size/max/limit/slot count): %u %u %u %u", rs->size, rs->maxKey, rs->keyLimit, rs->_slotsCount);
-    unsigned memory=rs->_topIndexLimit * sizeof(RadixItem ***);
-    memory+=memory;
-    memory+=rs->_slotsCount*(RADIX_SLOT_SIZE * sizeof(RadixItem *));
-    printf("\n   Memory: %u\n", memory);
-    if(listing && rs->size>0) {
-        int t = GET_TOP_INDEX(rs->maxKey);
-        int slotMin, slotSize, slotCount, l;
-        unsigned items=0;
-        do {
-            if(rs->topDigits[t]) {
-                printf("\n  Slot %u (size/min/max): %u %u %u",t, rs->_slotDescriptors[t]->size, rs->_slotDescriptors[t]->min, rs->_slotDescriptors[t]->max);
-                if(rs->_slotDescriptors[t]->size>0) {
-                    l=GET_LOW_INDEX(rs->_slotDescriptors[t]->max);
-                    slotMin=GET_LOW_INDEX(rs->_slotDescriptors[t]->min);
-                    slotSize=rs->_slotDescriptors[t]->size;
-                    slotCount=0;
-                    do {
-                        if(rs->topDigits[t][l]) {
-                            printf("\n    > %d #%u",l, ++items);
-                            ++slotCount;
-                            RadixItem *ri=rs->topDigits[t][l]->next;
-                            while(ri) {
-                                printf(" #%u",++items);
-                                ++slotCount;
-                                ri=ri->next;
-                            }
-                        }
-                    } while(--l>=slotMin && slotCount<slotSize);
-                    printf("\n    STOP @ %d",l);
-                } else {
-                    printf(" > SKIPPED");
-                }
+        if(keysOr==keysAnd) {
+            // candidates have the same key > any of them can be selected
+            break;
+        }
+        shift=(63-__builtin_clzll(keysOr^keysAnd))/RADIX_DIGIT_BITS*RADIX_DIGIT_BITS;
+        memset(counts, 0, sizeof(counts));
+        for(i=begin; i<end; i++) {
+            counts[(keys[i]>>shift)&(RADIX_DIGITS-1)]++;
+        }
+        for(digit=RADIX_DIGITS-1, bigger=0; begin+bigger+counts[digit]<count; digit--) {
+            bigger+=counts[digit];
+        }
+        for(lo=mid=begin, hi=end; mid<hi;) {
+            unsigned d=(keys[mid]>>shift)&(RADIX_DIGITS-1);
+            if(d>digit) {
+                radixsort_swap(keys, items, lo++, mid++);
+            } else if(d<digit) {
+                radixsort_swap(keys, items, mid, --hi);
+            } else {
+                mid++;
             }
-        } while(--t>=0);
-    }
-    fflush(stdout);
-}
-
-void radixsort_destroy(RadixSorter *rs)
-{
-    // radix items: DONE (passed on dump() by reference)
-    // rs: DONE (created and destroyed by caller)
-    // slots:
-    int topIndex = GET_TOP_INDEX(rs->maxKey);
-    do {
-        if(rs->topDigits[topIndex]) {
-            free(rs->topDigits[topIndex]);
-            free(rs->_slotDescriptors[topIndex]);
         }
-    } while(--topIndex>=0);
+        begin=lo;
+        end=hi;
+    }
 }
@@ -0,0 +1,118 @@
+/*
+ test_*.c       HSTR test
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/include/hstr_candidates.h"
+#include "../../src/include/hstr_casefold.h"
+
+static const char *items[]={
+    "ролик", "Рим", "ls -la", "ΣΙΓΜΑ", "σίσυφος", "git status", "Рим рим", "ps aux"
+};
+#define ITEMS (sizeof(items)/sizeof(items[0]))
+
+static void fold(char *folded, const char *text, int caseSensitive) {
+    if(caseSensitive) {
+        strcpy(folded, text);
+    } else {
+        casefold(folded, text, strlen(text)+1);
+    }
+}
+
+// candidates of pattern as HSTR narrows them: only candidates of the narrowest level are matched
+static unsigned narrow(CandidateStack *stack, const char *pattern, int caseSensitive) {
+    unsigned length=strlen(pattern), i, id;
+    char needle[64], haystack[64];
+    CandidateLevel *level=candidates_narrowest(stack, pattern, length);
+    if(!level || level->patternLength<length) {
+        unsigned *parentIds=level?level->ids:NULL;
+        unsigned parentCount=level?level->count:ITEMS;
+        level=candidates_push(stack, pattern, length, parentCount);
+        fold(needle, pattern, caseSensitive);
+        for(i=0; i<parentCount; i++) {
+            id=parentIds?parentIds[i]:i;
+            fold(haystack, items[id], caseSensitive);
+            if(strstr(haystack, needle)) {
+                level->offsets[level->count]=0;
+                level->ids[level->count++]=id;
+            }
+        }
+        level->prefixCount=level->count;
+    }
+    return level->count;
+}
+
+// candidates of pattern matched against all items
+static unsigned scan(const char *pattern, int caseSensitive) {
+    unsigned i, count=0;
+    char needle[64], haystack[64];
+    fold(needle, pattern, caseSensitive);
+    for(i=0; i<ITEMS; i++) {
+        fold(haystack, items[i], caseSensitive);
+        count+=strstr(haystack, needle)!=NULL;
+    }
+    return count;
+}
+
+// patterns are typed byte by byte (i.e. w/ incomplete UTF-8 characters) and deleted back
+void testTyping() {
+    const char *patterns[]={ "Рим", "РИМ", "ΣΊΣ", "Σ", "ps" };
+    char typed[64];
+    unsigned p, length, i, caseSensitive, errors=0, matched=0;
+    CandidateStack stack;
+    candidates_init(&stack);
+    for(caseSensitive=0; caseSensitive<2; caseSensitive++) {
+        for(p=0; p<sizeof(patterns)/sizeof(patterns[0]); p++) {
+            candidates_validate(&stack, (char**)items, ITEMS, 0, 0, caseSensitive);
+            length=strlen(patterns[p]);
+            for(i=1; i<=2*length; i++) {
+                memcpy(typed, patterns[p], i<=length?i:2*length-i);
+                typed[i<=length?i:2*length-i]=0;
+                if(narrow(&stack, typed, caseSensitive)!=scan(typed, caseSensitive)) {
+                    errors++;
+                }
+            }
+            matched+=scan(patterns[p], caseSensitive);
+            candidates_clear(&stack);
+        }
+    }
+    candidates_destroy(&stack);
+    printf("typing: %u matched, errors %u\n", matched, errors);
+}
+
+// levels are dropped once source or matching changes
+void testValidate() {
+    CandidateStack stack;
+    candidates_init(&stack);
+    candidates_validate(&stack, (char**)items, ITEMS, 0, 0, 0);
+    narrow(&stack, "r", 0);
+    narrow(&stack, "ro", 0);
+    bool kept=candidates_validate(&stack, (char**)items, ITEMS, 0, 0, 0);
+    unsigned depth=stack.depth;
+    bool dropped=!candidates_validate(&stack, (char**)items, ITEMS, 0, 0, 1);
+    printf("validate: depth %u kept %d, dropped %d depth %u\n", depth, kept, dropped, stack.depth);
+    candidates_destroy(&stack);
+}
+
+int main(int argc, char *argv[])
+{
+    testTyping();
+    testValidate();
+}
@@ -0,0 +1,95 @@
+/*
+ test_*.c       HSTR test
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../../src/include/hstr_dedup.h"
+
+// the second occurrence of id is rejected until the next selection begins
+void testAdd() {
+    SelectionDedup dedup;
+    unsigned ids[]={ 3, 0, 3, 200, 0, 199, 200 };
+    unsigned i, added=0;
+    dedup_init(&dedup);
+    dedup_begin(&dedup);
+    for(i=0; i<sizeof(ids)/sizeof(ids[0]); i++) {
+        added+=dedup_add(&dedup, ids[i]);
+    }
+    dedup_begin(&dedup);
+    printf("add: added %u, again %d, words %zu\n", added, dedup_add(&dedup, 3) && !dedup_add(&dedup, 3), dedup.words);
+    dedup_destroy(&dedup);
+}
+
+// bitset is as big as dense ids - not as the commands are long
+void testDense() {
+    SelectionDedup dedup;
+    unsigned i, selection, errors=0;
+    dedup_init(&dedup);
+    for(selection=0; selection<100; selection++) {
+        dedup_begin(&dedup);
+        for(i=0; i<1000; i++) {
+            errors+=dedup_add(&dedup, i)!=true;
+            errors+=dedup_add(&dedup, i/2)!=false;
+        }
+    }
+    printf("dense: errors %u, words %zu\n", errors, dedup.words);
+    dedup_destroy(&dedup);
+}
+
+// commands w/o dense ids get the same id in one selection
+void testIntern() {
+    SelectionDedup dedup;
+    char command[]="git status";
+    unsigned a, b, c, d;
+    bool first, second;
+    dedup_init(&dedup);
+    dedup_begin(&dedup);
+    a=dedup_intern(&dedup, "ls -la", 6);
+    b=dedup_intern(&dedup, command, 10);
+    // interned commands are copies - the original may change
+    command[0]='G';
+    c=dedup_intern(&dedup, "git status", 10);
+    d=dedup_intern(&dedup, "ls -la", 6);
+    first=dedup_add(&dedup, b);
+    second=dedup_add(&dedup, c);
+    printf("intern: ids %u %u %u %u, added %d %d\n", a, b, c, d, first, second);
+    dedup_begin(&dedup);
+    printf("intern: new selection id %u\n", dedup_intern(&dedup, "make", 4));
+    dedup_destroy(&dedup);
+}
+
+// generation wrapping around doesn't take stale words as current ones
+void testGeneration() {
+    SelectionDedup dedup;
+    dedup_init(&dedup);
+    dedup_begin(&dedup);
+    dedup_add(&dedup, 5);
+    dedup.generation=0u-1;
+    dedup_begin(&dedup);
+    printf("generation: %u, added %d\n", dedup.generation, dedup_add(&dedup, 5));
+    dedup_destroy(&dedup);
+}
+
+int main(int argc, char *argv[])
+{
+    testAdd();
+    testDense();
+    testIntern();
+    testGeneration();
+}
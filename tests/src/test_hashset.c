@@ -16,7 +16,11 @@
  limitations under the License.
 */
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "../../src/include/hashset.h"
+#include "../../src/include/hstr_intern.h"
 #include "../../src/include/hstr_utils.h"
 
 void testBlacklist() {
@@ -41,15 +45,96 @@ void testGetKeys() {
         hashset_add(&blacklist, commandBlacklist[i]);
     }
 
-    char **keys=hashset_keys(&blacklist);
-    if(keys) {
-        for(i=0; i<hashset_size(&blacklist); i++) {
-            printf("\nKey: %s", keys[i]);
+    HashSetIterator it;
+    const char *key;
+    hashset_iterator_init(&it, &blacklist);
+    while((key=hashset_iterator_next(&it, NULL, NULL))!=NULL) {
+        printf("\nKey: %s", key);
+    }
+}
+
+void testRemove() {
+    const char* commandBlacklist[] = { "a","b","c","d","e" };
+    HashSet blacklist;
+    int i;
+    hashset_init(&blacklist);
+    for (i = 0; i < 5; i++) {
+        hashset_add(&blacklist, commandBlacklist[i]);
+    }
+    printf("\nremoved %d", hashset_remove(&blacklist, "c"));
+    printf("\nremoved again %d", hashset_remove(&blacklist, "c"));
+    for (i = 0; i < 5; i++) {
+        printf("\nmatch %s %d", commandBlacklist[i], hashset_contains(&blacklist, commandBlacklist[i]));
+    }
+    printf("\nsize %d\n", hashset_size(&blacklist));
+}
+
+void testGrow() {
+    HashSet set;
+    char key[32];
+    int i, missing=0;
+    hashset_init(&set);
+    for (i = 0; i < 100000; i++) {
+        sprintf(key, "cmd %d", i);
+        hashset_add(&set, key);
+    }
+    for (i = 0; i < 100000; i+=2) {
+        sprintf(key, "cmd %d", i);
+        hashset_remove(&set, key);
+    }
+    for (i = 0; i < 100000; i++) {
+        sprintf(key, "cmd %d", i);
+        if(hashset_contains(&set, key) != (i%2)) {
+            missing++;
+        }
+    }
+    printf("grow size %d wrong %d\n", hashset_size(&set), missing);
+    hashset_destroy(&set, false);
+}
+
+void testIntern() {
+    char corpus[] = "ls -la\0git status\0ls -la\0make";
+    InternTable table;
+    unsigned a, b, c, d;
+    intern_init(&table, ARENA_HASHSET);
+    a=intern_id(&table, corpus, 6);
+    b=intern_id(&table, corpus+7, 10);
+    c=intern_id(&table, corpus+18, 6);
+    d=intern_id(&table, "ls", 2);
+    printf("ids %u %u %u %u count %u\n", a, b, c, d, table.count);
+    printf("borrowed %d lookup %u missing %d\n", intern_string(&table, c)==corpus,
+            intern_lookup(&table, "git status", 10), intern_lookup(&table, "mak", 3)==INTERN_ID_NONE);
+    intern_destroy(&table);
+}
+
+// NUL terminated key (even the one ending the last mapped page) hashes as its view
+void testHashString() {
+    long pageSize=sysconf(_SC_PAGESIZE);
+    char *page=mmap(NULL, pageSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    char *key, *nul;
+    unsigned length, hash, keyLength, gap, wrong=0;
+    memset(page, 'x', pageSize);
+    for (keyLength = 0; keyLength < 40; keyLength++) {
+        for (gap = 0; gap < 10; gap++) {
+            nul=page+pageSize-1-gap;
+            key=nul-keyLength;
+            *nul=0;
+            hash=hashmap_hash_string(key, &length);
+            if(length!=keyLength || hash!=hashmap_hash(key, keyLength)) {
+                wrong++;
+            }
+            *nul='x';
         }
     }
+    printf("hash string wrong %u\n", wrong);
+    munmap(page, pageSize);
 }
 
 int main(int argc, char *argv[])
 {
     testGetKeys();
+    testRemove();
+    testGrow();
+    testIntern();
+    testHashString();
 }
@@ -0,0 +1,267 @@
+/*
+ test_*.c       HSTR test
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../src/include/hstr_history.h"
+#include "../../src/include/hstr_index.h"
+#include "../../src/include/hstr_lexer.h"
+#include "../../src/include/hstr_ranking.h"
+
+#define INDEX_FINGERPRINT 42
+
+static char home[]="/tmp/hh_test_index_XXXXXX";
+static char historyFile[128];
+static HashSet blacklist;
+
+static void writeHistory(const char *content, const char *mode) {
+    FILE *file=fopen(historyFile, mode);
+    fputs(content, file);
+    fclose(file);
+}
+
+// index of history file content: its commands are the ranked items
+static void saveIndex(const char *content) {
+    static char corpus[256];
+    static char *items[8];
+    static unsigned lengths[8], hashes[8], ranks[8], lastOccurrences[8];
+    HistoryItems history;
+    HistoryIndexState state;
+    struct stat historyStat;
+    size_t size=strlen(content), i, count=0;
+
+    memset(&history, 0, sizeof(history));
+    memcpy(corpus, content, size+1);
+    for(i=0; i<size; i++) {
+        if(corpus[i]=='\n') {
+            corpus[i]=0;
+        }
+    }
+    for(i=0; i<size; i+=lengths[count++]+1) {
+        items[count]=corpus+i;
+        lengths[count]=strlen(items[count]);
+        hashes[count]=hashmap_hash(items[count], lengths[count]);
+        ranks[count]=count;
+        lastOccurrences[count]=count;
+    }
+    history.corpus=corpus;
+    history.foldedCorpus=corpus;
+    history.corpusSize=size;
+    history.items=items;
+    history.lengths=lengths;
+    history.hashes=hashes;
+    history.count=count;
+    history.rankedCount=count;
+
+    state.indexedSize=size;
+    state.indexedWords=history_index_checksum_words(HH_INDEX_CHECKSUM_BASIS, content, 0, size);
+    state.indexedChecksum=history_index_checksum_finish(state.indexedWords, content, size);
+    state.lineCount=count;
+    state.hasTimestamps=false;
+    state.lastTimestamp=0;
+    state.ranks=ranks;
+    state.lastOccurrences=lastOccurrences;
+
+    stat(historyFile, &historyStat);
+    history_index_save(&historyStat, INDEX_FINGERPRINT, &state, &history);
+}
+
+static int loadIndex(unsigned fingerprint) {
+    HistoryItems history;
+    HistoryIndexState state;
+    struct stat historyStat;
+    stat(historyFile, &historyStat);
+    int result=history_index_load(historyFile, &historyStat, fingerprint, &state, &history);
+    if(result!=HH_INDEX_INVALID) {
+        free(history.items);
+        free(history.lengths);
+        free(history.hashes);
+        free(history.ranks);
+        free(history.rawItems);
+        free(history.rawLengths);
+        free(history.rawTimestamps);
+        free(history.rawIds);
+        history_index_close();
+    }
+    return result;
+}
+
+static const char *indexName(int result) {
+    switch(result) {
+    case HH_INDEX_CURRENT:
+        return "current";
+    case HH_INDEX_PREFIX:
+        return "prefix";
+    default:
+        return "invalid";
+    }
+}
+
+static void check(const char *test, int result, int expected, unsigned *errors) {
+    if(result!=expected) {
+        printf("  %s: %s (expected %s)\n", test, indexName(result), indexName(expected));
+        (*errors)++;
+    }
+}
+
+// index is used only as long as indexed history file is current or it's only appended
+void testInvalidation() {
+    const char *content="ls -la\ngit status\ncd /tmp\n";
+    char indexFile[128];
+    unsigned errors=0;
+    sprintf(indexFile, "%s/%s", home, FILE_HH_INDEX);
+
+    writeHistory(content, "w");
+    saveIndex(content);
+    check("unchanged", loadIndex(INDEX_FINGERPRINT), HH_INDEX_CURRENT, &errors);
+    check("configuration", loadIndex(INDEX_FINGERPRINT+1), HH_INDEX_INVALID, &errors);
+
+    writeHistory("make\n", "a");
+    check("appended", loadIndex(INDEX_FINGERPRINT), HH_INDEX_PREFIX, &errors);
+
+    // indexed prefix is edited while history file keeps its size
+    writeHistory("ls -lA\ngit status\ncd /tmp\nmake\n", "w");
+    check("prefix edit", loadIndex(INDEX_FINGERPRINT), HH_INDEX_INVALID, &errors);
+    writeHistory("ls -la\ngit status\ncd /tmp\nmake\n", "w");
+    check("prefix restored", loadIndex(INDEX_FINGERPRINT), HH_INDEX_PREFIX, &errors);
+
+    writeHistory("ls -la\ngit\n", "w");
+    check("truncated", loadIndex(INDEX_FINGERPRINT), HH_INDEX_INVALID, &errors);
+
+    // history file replaced by another file (e.g. rotated) is not its continuation
+    writeHistory(content, "w");
+    saveIndex(content);
+    char replacement[160];
+    sprintf(replacement, "%s.new", historyFile);
+    FILE *file=fopen(replacement, "w");
+    fputs(content, file);
+    fclose(file);
+    rename(replacement, historyFile);
+    check("replaced", loadIndex(INDEX_FINGERPRINT), HH_INDEX_INVALID, &errors);
+
+    // partially written index
+    writeHistory(content, "w");
+    saveIndex(content);
+    struct stat indexStat;
+    stat(indexFile, &indexStat);
+    truncate(indexFile, indexStat.st_size-1);
+    check("corrupt", loadIndex(INDEX_FINGERPRINT), HH_INDEX_INVALID, &errors);
+
+    printf("invalidation: errors %u\n", errors);
+    unlink(indexFile);
+}
+
+// generated history: commands repeat with different periods, some of them are timestamped
+static void writeGeneratedHistory(unsigned from, unsigned to, const char *mode) {
+    FILE *file=fopen(historyFile, mode);
+    unsigned i;
+    for(i=from; i<to; i++) {
+        if(i%5==0) {
+            fprintf(file, "#%u\n", 1600000000+60*i);
+        }
+        if(i%3==0) {
+            fprintf(file, "git commit -m %u\n", i%7);
+        } else if(i%3==1) {
+            fprintf(file, "make %u\n", i%97);
+        } else {
+            fprintf(file, "ls %u\n", i);
+        }
+    }
+    fclose(file);
+}
+
+// ranked and raw items of prioritized history in their final order
+static char *rankHistory(int ranking) {
+    HistoryItems *history=get_prioritized_history(ranking, &blacklist, false);
+    history_rank_items(history, history->count);
+    size_t size=1;
+    unsigned i;
+    for(i=0; i<history->count; i++) {
+        size+=history->lengths[i]+1;
+    }
+    for(i=0; i<history->rawCount; i++) {
+        size+=strlen(history->rawItems[i])+16;
+    }
+    char *result=malloc(size), *end=result;
+    for(i=0; i<history->count; i++) {
+        end+=sprintf(end, "%s\n", history->items[i]);
+    }
+    for(i=0; i<history->rawCount; i++) {
+        end+=sprintf(end, "%u %s\n", history->rawTimestamps[i], history->rawItems[i]);
+    }
+    free_prioritized_history();
+    return result;
+}
+
+// history ranked from index and lines appended since it was saved equals history ranked from scratch
+void testAppend() {
+    const unsigned LINES=3000, cuts[]={ 1, 100, LINES/3, LINES-1 };
+    const int rankings[]={ HISTORY_RANKING_ORDER, HISTORY_RANKING_TIME_DECAY, HISTORY_RANKING_ADDITIVE };
+    char indexFile[128];
+    unsigned c, r, errors=0, prefixes=0;
+    sprintf(indexFile, "%s/%s", home, FILE_HH_INDEX);
+
+    for(r=0; r<sizeof(rankings)/sizeof(rankings[0]); r++) {
+        for(c=0; c<sizeof(cuts)/sizeof(cuts[0]); c++) {
+            unlink(indexFile);
+            writeGeneratedHistory(0, cuts[c], "w");
+            free(rankHistory(rankings[r]));
+            writeGeneratedHistory(cuts[c], LINES, "a");
+            prefixes+=loadIndex(history_index_fingerprint(HISTORY_FORMAT_BASH, rankings[r], &blacklist))==HH_INDEX_PREFIX;
+            char *appended=rankHistory(rankings[r]);
+            // index saved by appending is current
+            char *current=rankHistory(rankings[r]);
+            unlink(indexFile);
+            char *cold=rankHistory(rankings[r]);
+            if(strcmp(appended, cold) || strcmp(current, cold)) {
+                printf("  ranking %d, cut %u: appended %s, current %s\n", rankings[r], cuts[c],
+                        strcmp(appended, cold)?"differs":"same", strcmp(current, cold)?"differs":"same");
+                errors++;
+            }
+            free(appended);
+            free(current);
+            free(cold);
+        }
+    }
+    printf("append: %u prefix indices, errors %u\n", prefixes, errors);
+    unlink(indexFile);
+}
+
+int main(int argc, char *argv[])
+{
+    if(!mkdtemp(home)) {
+        return 1;
+    }
+    setenv("HOME", home, 1);
+    sprintf(historyFile, "%s/.bash_history", home);
+    setenv("HISTFILE", historyFile, 1);
+    hashset_init(&blacklist);
+
+    testInvalidation();
+    testAppend();
+
+    hashset_destroy(&blacklist, false);
+    unlink(historyFile);
+    rmdir(home);
+}
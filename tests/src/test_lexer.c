@@ -0,0 +1,75 @@
+/*
+ test_lexer.c       A test for BASH and zsh history lexer
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/include/hstr_lexer.h"
+
+void lex(const char *history, int format, bool hasTimestamps, const char **commands, unsigned *timestamps)
+{
+    char *buffer=strdup(history);
+    HistoryLexer lexer;
+    HistoryRecord record;
+    unsigned i=0;
+    history_lexer_init(&lexer, buffer, buffer+strlen(buffer), format, hasTimestamps, 0);
+    while(history_lexer_next(&lexer, &record)) {
+        printf("\n  %u '%s'", record.timestamp, record.command?record.command:"(timestamp)");
+        assert(commands[i]);
+        if(record.command) {
+            assert(!strcmp(commands[i], record.command));
+        } else {
+            assert(!strlen(commands[i]));
+        }
+        assert(timestamps[i]==record.timestamp);
+        i++;
+    }
+    assert(!commands[i]);
+    free(buffer);
+}
+
+int main(int argc, char *argv[])
+{
+    printf("BASH w/ timestamps:");
+    const char *bashTimestamped="#1500000000\nls\n\n#1500000060\r\ngit status\r\n#1 is timestamp too\nunterminated";
+    const char *bashTimestampedCommands[]={"ls", "git status", NULL};
+    unsigned bashTimestampedTimestamps[]={1500000000, 1500000060};
+    lex(bashTimestamped, HISTORY_FORMAT_BASH, true, bashTimestampedCommands, bashTimestampedTimestamps);
+
+    printf("\nBASH w/ timestamps appended to history w/o timestamps:");
+    const char *bash="ls\n#1500000000\ngit status\n#123 comment\n";
+    const char *bashCommands[]={"ls", "", "git status", "#123 comment", NULL};
+    unsigned bashTimestamps[]={0, 1500000000, 1500000000, 1500000000};
+    lex(bash, HISTORY_FORMAT_BASH, false, bashCommands, bashTimestamps);
+
+    printf("\nzsh extended history:");
+    const char *zsh=": 1500000000:0;ls\n: 1500000060:12;for i in 1 2\\\ndo echo\\\ndone\n: 1500000120:0;echo \x83\xa3\nends with \\\\\n";
+    const char *zshCommands[]={"ls", "for i in 1 2\ndo echo\ndone", "echo \x83", "ends with \\\\", NULL};
+    unsigned zshTimestamps[]={1500000000, 1500000060, 1500000120, 1500000120};
+    lex(zsh, HISTORY_FORMAT_ZSH, false, zshCommands, zshTimestamps);
+
+    char *end=(char*)zsh+strlen(zsh);
+    assert(history_lexer_record_end((char*)zsh, (char*)zsh+20, end, HISTORY_FORMAT_ZSH)==strstr(zsh, ": 1500000120"));
+
+    printf("\nOK\n");
+    return 0;
+}
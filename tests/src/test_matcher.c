@@ -0,0 +1,134 @@
+/*
+ test_*.c       HSTR test
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../src/include/hstr_casefold.h"
+#include "../../src/include/hstr_matcher.h"
+
+#define HAYSTACKS 20000
+#define HAYSTACK_SIZE 100
+
+#define MIN(a,b) ((a)<(b)?(a):(b))
+
+static const char alphabet[]="aAbBgit -\xc4\x8d";
+
+static void randomString(char *s, unsigned length) {
+    unsigned i;
+    for(i=0; i<length; i++) {
+        s[i]=alphabet[rand()%(sizeof(alphabet)-1)];
+    }
+    s[length]=0;
+}
+
+// offsets are the same as the ones of strstr() for haystacks of all lengths
+void testFind() {
+    char haystack[HAYSTACK_SIZE+1], needle[9];
+    unsigned h, length, errors=0, found=0;
+    int offset;
+    char *expected;
+    Matcher matcher;
+    srand(7);
+    for(h=0; h<HAYSTACKS; h++) {
+        length=rand()%HAYSTACK_SIZE;
+        randomString(haystack, length);
+        randomString(needle, 1+rand()%(h%4?3:8));
+        matcher_init(&matcher, needle, strlen(needle));
+        offset=matcher_find(&matcher, haystack, length);
+        expected=strstr(haystack, needle);
+        if(expected?offset!=expected-haystack:offset!=MATCHER_NONE) {
+            errors++;
+        }
+        found+=offset!=MATCHER_NONE;
+        matcher_destroy(&matcher);
+    }
+    printf("find (%s): %u found, errors %u\n", matcher_kernel_name(), found, errors);
+}
+
+static const char *commands[]={
+    "git commit -a -m 'fix %u'", "ls -la /tmp/build%u", "docker run --rm -it image:%u",
+    "ssh admin@host%u.example.com", "cd ~/src/project%u", "make -j%u install"
+};
+
+static double elapsed(struct timespec *begin, struct timespec *end) {
+    return ((end->tv_sec-begin->tv_sec)*1e9+(end->tv_nsec-begin->tv_nsec))/1e6;
+}
+
+// the best time of rounds is taken as the bench is short
+static void benchNeedle(char haystacks[][HAYSTACK_SIZE+1], unsigned *lengths, const char *name, const char *needle) {
+    unsigned h, round, found=0, expected=0;
+    double matcherTime=1e9, strstrTime=1e9;
+    struct timespec begin, middle, end;
+    Matcher matcher;
+    matcher_init(&matcher, needle, strlen(needle));
+    for(round=0; round<20; round++) {
+        found=expected=0;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        for(h=0; h<HAYSTACKS; h++) {
+            found+=matcher_find(&matcher, haystacks[h], lengths[h])!=MATCHER_NONE;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &middle);
+        for(h=0; h<HAYSTACKS; h++) {
+            expected+=strstr(haystacks[h], needle)!=NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        matcherTime=MIN(matcherTime, elapsed(&begin, &middle));
+        strstrTime=MIN(strstrTime, elapsed(&middle, &end));
+    }
+    matcher_destroy(&matcher);
+    printf("bench %s '%s': matcher %.3fms strstr %.3fms (%u/%u found)\n",
+            name, needle, matcherTime, strstrTime, found, expected);
+}
+
+void benchFind() {
+    static char haystacks[HAYSTACKS][HAYSTACK_SIZE+1];
+    static unsigned lengths[HAYSTACKS];
+    unsigned h;
+    for(h=0; h<HAYSTACKS; h++) {
+        randomString(haystacks[h], HAYSTACK_SIZE);
+        lengths[h]=HAYSTACK_SIZE;
+    }
+    benchNeedle(haystacks, lengths, "random", "git -");
+    for(h=0; h<HAYSTACKS; h++) {
+        lengths[h]=sprintf(haystacks[h], commands[h%(sizeof(commands)/sizeof(commands[0]))], rand()%1000);
+    }
+    benchNeedle(haystacks, lengths, "commands", "commit -a");
+    benchNeedle(haystacks, lengths, "commands", "kubectl");
+}
+
+// folded text has the same length as the text and folds letters of non-ASCII scripts
+void testCasefold() {
+    const char *text="ÁČĎ Straße ΣΊΣΥΦΟΣ МОСКВА Ǆ İ \xff\xc4";
+    const char *expected="áčď straße σίσυφοσ москва ǆ İ \xff\xc4";
+    char folded[64];
+    size_t size=strlen(text)+1;
+    casefold(folded, text, size);
+    printf("casefold: %s\n", memcmp(folded, expected, size)?"FAILED":"OK");
+}
+
+int main(int argc, char *argv[])
+{
+    testCasefold();
+    testFind();
+    benchFind();
+}
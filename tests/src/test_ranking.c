@@ -16,9 +16,12 @@
  limitations under the License.
 */
 
+#include <assert.h>
 #include <stdio.h>
 #include <math.h>
 
+#include "../../src/include/hstr_ranking.h"
+
 void testLog() {
     const int HISTORY_SIZE=2000;
     int i;
@@ -27,6 +30,28 @@ void testLog() {
     }
 }
 
+// table-driven log must rank exactly as floor(10*ln(order)) in double precision
+void testLogTable() {
+    unsigned i, value;
+    for(i=1; i<10000000; i++) {
+        assert(ranking_log(i)==(unsigned)(log(i)*10.0));
+    }
+    for(value=1; value<RANKING_LOG_VALUES; value++) {
+        i=rankingLogThresholds[value];
+        assert(ranking_log(i)==(unsigned)(log(i)*10.0));
+        assert(ranking_log(i-1)==(unsigned)(log(i-1)*10.0));
+    }
+    assert(ranking_log(UINT_MAX)==RANKING_LOG_VALUES-1);
+    printf("\nlog table OK");
+}
+
+void testTimeDecayHorizon() {
+    unsigned now=1500000000;
+    assert(ranking_time_decay(now, now-HISTORY_TIME_DECAY_HORIZON)==now);
+    assert(ranking_time_decay(now, now)==now+HISTORY_TIME_DECAY_HALF_LIFE);
+    printf("\ntime-decay OK");
+}
+
 #define MAX_CHARACTER_CODE 10000
 static char line[MAX_CHARACTER_CODE];
 
@@ -69,6 +94,8 @@ void testGenerateHugeHistoryFileWithSameLines()
 
 int main(int argc, char *argv[])
 {
+    testLogTable();
+    testTimeDecayHorizon();
     testGenerateHugeHistoryFileWithSameLines();
 }
 
@@ -0,0 +1,138 @@
+/*
+ test_*.c       HSTR test
+
+ Copyright (C) 2014  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../src/include/hstr_rankmap.h"
+
+#define KEYS 5000
+#define OCCURRENCES 400000
+
+static char keys[KEYS][16];
+static unsigned lengths[KEYS];
+static unsigned hashes[KEYS];
+
+typedef struct {
+    ConcurrentRankMap *map;
+    unsigned begin;
+    unsigned end;
+} Job;
+
+// occurrence i is an occurrence of pseudo-random key which contributes i%7
+static unsigned keyOf(unsigned i) {
+    return (i*2654435761u>>7)%KEYS;
+}
+
+static void *rank(void *arg) {
+    Job *job=arg;
+    unsigned i, k;
+    for(i=job->begin; i<job->end; i++) {
+        k=keyOf(i);
+        concurrent_rankmap_add(job->map, keys[k], lengths[k], hashes[k], i%7, i);
+    }
+    return NULL;
+}
+
+static double rankConcurrently(unsigned threads, FrozenRankMap *frozen) {
+    ConcurrentRankMap *map=concurrent_rankmap_new(ARENA_RANKING);
+    pthread_t ids[64];
+    Job jobs[64];
+    struct timespec begin, end;
+    unsigned t;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for(t=0; t<threads; t++) {
+        jobs[t].map=map;
+        jobs[t].begin=(unsigned long)OCCURRENCES*t/threads;
+        jobs[t].end=(unsigned long)OCCURRENCES*(t+1)/threads;
+        pthread_create(&ids[t], NULL, rank, &jobs[t]);
+    }
+    for(t=0; t<threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    concurrent_rankmap_freeze(map, frozen);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(map);
+    return (end.tv_sec-begin.tv_sec)+(end.tv_nsec-begin.tv_nsec)/1e9;
+}
+
+// frozen maps of any thread count are the same as the one ranked serially
+void testStress() {
+    unsigned expectedRanks[KEYS], expectedLast[KEYS];
+    unsigned i, k, t, errors=0;
+    memset(expectedRanks, 0, sizeof(expectedRanks));
+    for(i=0; i<OCCURRENCES; i++) {
+        k=keyOf(i);
+        expectedRanks[k]+=i%7;
+        expectedLast[k]=i;
+    }
+    FrozenRankMap serial, frozen;
+    rankConcurrently(1, &serial);
+    for(t=2; t<=16; t*=2) {
+        rankConcurrently(t, &frozen);
+        if(frozen.count!=serial.count) {
+            errors++;
+        }
+        for(i=0; i<frozen.count && i<serial.count; i++) {
+            if(frozen.items[i]!=serial.items[i] || frozen.ranks[i]!=serial.ranks[i]
+                    || frozen.lastOccurrences[i]!=serial.lastOccurrences[i]) {
+                errors++;
+            }
+            k=frozen_rankmap_find(&frozen, frozen.items[i], frozen.lengths[i]);
+            if(k!=i) {
+                errors++;
+            }
+        }
+        for(k=0; k<KEYS; k++) {
+            i=frozen_rankmap_find(&frozen, keys[k], lengths[k]);
+            if(i==RANKMAP_NONE || frozen.ranks[i]!=expectedRanks[k] || frozen.lastOccurrences[i]!=expectedLast[k]) {
+                errors++;
+            }
+        }
+        frozen_rankmap_destroy(&frozen);
+    }
+    printf("stress: %u keys, errors %u, missing %d\n", serial.count, errors,
+            frozen_rankmap_find(&serial, "missing", 7)==RANKMAP_NONE);
+    frozen_rankmap_destroy(&serial);
+}
+
+void benchThroughput() {
+    FrozenRankMap frozen;
+    unsigned t;
+    double seconds;
+    for(t=1; t<=16; t*=2) {
+        seconds=rankConcurrently(t, &frozen);
+        printf("threads %2u: %.1f M adds/s\n", t, OCCURRENCES/seconds/1e6);
+        frozen_rankmap_destroy(&frozen);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned k;
+    for(k=0; k<KEYS; k++) {
+        lengths[k]=sprintf(keys[k], "cmd %u", k);
+        hashes[k]=hashmap_hash(keys[k], lengths[k]);
+    }
+    testStress();
+    benchThroughput();
+}
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+gcc -std=c99 -O2 ./src/test_candidates.c ../src/hstr_candidates.c ../src/hstr_casefold.c -o _candidates
+
+# eof
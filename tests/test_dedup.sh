@@ -0,0 +1,5 @@
+#!/bin/bash
+
+gcc -std=c99 -O2 ./src/test_dedup.c ../src/hstr_dedup.c ../src/hstr_intern.c ../src/hashset.c ../src/hstr_arena.c -lpthread -o _dedup
+
+# eof
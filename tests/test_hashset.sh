@@ -1,6 +1,6 @@
 #!/bin/bash
 
 clear
-gcc ./src/test_hashset.c ../src/hashset.c ../src/hstr_utils.c -o _hashset
+gcc ./src/test_hashset.c ../src/hashset.c ../src/hstr_arena.c ../src/hstr_intern.c ../src/hstr_utils.c -lpthread -o _hashset
 
 # eof
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+gcc -std=c99 -O2 ./src/test_index.c ../src/hstr_history.c ../src/hstr_index.c ../src/hstr_lexer.c ../src/hstr_ranking.c ../src/hstr_rankmap.c ../src/radixsort.c ../src/hstr_casefold.c ../src/hashset.c ../src/hstr_arena.c ../src/hstr_intern.c ../src/hstr_utils.c -lreadline -lpthread -lm -o _index
+
+# eof
@@ -0,0 +1,8 @@
+#!/bin/bash
+
+clear
+rm -vf _lexer
+gcc -std=c99 ./src/test_lexer.c ../src/hstr_lexer.c -o _lexer
+./_lexer
+
+# eof
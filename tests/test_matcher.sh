@@ -0,0 +1,5 @@
+#!/bin/bash
+
+gcc -std=c99 -O2 ./src/test_matcher.c ../src/hstr_matcher.c ../src/hstr_casefold.c -o _matcher
+
+# eof
@@ -1,5 +1,5 @@
 #!/bin/bash
 
-gcc ./src/test_ranking.c -lm -o _ranking
+gcc -std=c99 ./src/test_ranking.c ../src/hstr_ranking.c -lm -o _ranking
 
 # eof
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+gcc -std=c99 -O2 ./src/test_rankmap.c ../src/hstr_rankmap.c ../src/hashset.c ../src/hstr_arena.c -lpthread -o _rankmap
+
+# eof